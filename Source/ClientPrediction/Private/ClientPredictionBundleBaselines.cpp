@@ -0,0 +1,213 @@
+﻿#include "ClientPredictionBundleBaselines.h"
+
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "UObject/CoreNet.h"
+
+#include "ClientPredictionDeltaEncoding.h"
+#include "ClientPredictionNetSerialization.h"
+
+namespace ClientPrediction {
+    static void WriteBytes(FArchive& Ar, TArrayView<const uint8> Bytes) {
+        uint32 NumBytes = static_cast<uint32>(Bytes.Num());
+        Ar.SerializeIntPacked(NumBytes);
+        Ar.Serialize(const_cast<uint8*>(Bytes.GetData()), NumBytes);
+    }
+
+    static bool ReadBytes(FArchive& Ar, TArray<uint8>& OutBytes) {
+        uint32 NumBytes = 0;
+        Ar.SerializeIntPacked(NumBytes);
+
+        // The count comes from the network, so it is checked against what is actually left before allocating anything.
+        if (Ar.IsError() || NumBytes > static_cast<uint32>(Ar.TotalSize() - Ar.Tell())) { return false; }
+
+        OutBytes.SetNumUninitialized(NumBytes, EAllowShrinking::No);
+        Ar.Serialize(OutBytes.GetData(), NumBytes);
+
+        return !Ar.IsError();
+    }
+
+    void FBundleBaselines::Add(uint32 Sequence, const TArray<uint8>& SerializedBits, int32 NumberOfBits, const TArray<int32>& PacketEndBits) {
+        FBaseline& Baseline = Reserve(Sequence);
+
+        FNetBitReader& BitReader = FScratchArchives::GetReader(SerializedBits, NumberOfBits);
+        uint32 NumPackets = 0;
+        BitReader.SerializeIntPacked(NumPackets);
+
+        // The packet buffers of the slot are reused, so they're resized in place rather than recreated.
+        Baseline.Packets.SetNum(PacketEndBits.Num(), EAllowShrinking::No);
+        Baseline.PacketNumBits.Reset();
+
+        int32 PacketStartBit = static_cast<int32>(BitReader.GetPosBits());
+        for (int32 PacketIdx = 0; PacketIdx < PacketEndBits.Num(); ++PacketIdx) {
+            const int32 PacketEndBit = PacketEndBits[PacketIdx];
+            const int32 PacketNumBits = PacketEndBit - PacketStartBit;
+
+            TArray<uint8>& Packet = Baseline.Packets[PacketIdx];
+            Packet.Reset();
+            Packet.SetNumZeroed(FMath::DivideAndRoundUp(PacketNumBits, 8), EAllowShrinking::No);
+            BitReader.SerializeBits(Packet.GetData(), PacketNumBits);
+
+            // The unused bits of the last byte are cleared so that both sides end up with exactly the same bytes.
+            if (PacketNumBits % 8 != 0) {
+                Packet.Last() &= (1 << (PacketNumBits % 8)) - 1;
+            }
+
+            Baseline.PacketNumBits.Add(PacketNumBits);
+            PacketStartBit = PacketEndBit;
+        }
+    }
+
+    void FBundleBaselines::Ack(const UPackageMap* Connection, uint32 Sequence) {
+        if (Sequence == kNoBaseline) {
+            AckedSequences.Remove(Connection);
+            return;
+        }
+
+        // Connections that went away are only cleaned up when a new one shows up, since that is the only time the map grows.
+        if (!AckedSequences.Contains(Connection)) {
+            for (auto It = AckedSequences.CreateIterator(); It; ++It) {
+                if (!It.Key().IsValid()) { It.RemoveCurrent(); }
+            }
+        }
+
+        // Acks are sent unreliably so they can arrive out of order.
+        uint32& AckedSequence = AckedSequences.FindOrAdd(Connection, kNoBaseline);
+        AckedSequence = FMath::Max(AckedSequence, Sequence);
+    }
+
+    uint32 FBundleBaselines::GetBaselineSequence(const UPackageMap* Connection) const {
+        const uint32* AckedSequence = AckedSequences.Find(Connection);
+        if (AckedSequence == nullptr || Find(*AckedSequence) == nullptr) { return kNoBaseline; }
+
+        return *AckedSequence;
+    }
+
+    bool FBundleBaselines::Encode(uint32 Sequence, uint32 BaselineSequence, TArray<uint8>& OutPayload) const {
+        const FBaseline* Bundle = Find(Sequence);
+        if (Bundle == nullptr) { return false; }
+
+        // Every packet is compared against the newest packet of the baseline, since that is the state that is closest to all of them.
+        const FBaseline* Baseline = Find(BaselineSequence);
+        const TArrayView<const uint8> Base = Baseline != nullptr && !Baseline->Packets.IsEmpty() ? TArrayView<const uint8>(Baseline->Packets.Last()) : TArrayView<const uint8>();
+
+        OutPayload.Reset();
+        FMemoryWriter Ar(OutPayload);
+
+        uint32 WrittenBaselineSequence = Baseline != nullptr ? BaselineSequence : kNoBaseline;
+        Ar.SerializeIntPacked(Sequence);
+        Ar.SerializeIntPacked(WrittenBaselineSequence);
+
+        uint32 NumPackets = static_cast<uint32>(Bundle->Packets.Num());
+        Ar.SerializeIntPacked(NumPackets);
+
+        TArray<uint8>& Delta = DeltaScratch;
+        for (int32 PacketIdx = 0; PacketIdx < Bundle->Packets.Num(); ++PacketIdx) {
+            const TArray<uint8>& Packet = Bundle->Packets[PacketIdx];
+
+            bool bIsDelta = false;
+            if (Baseline != nullptr) {
+                FDeltaEncoding::Encode(Base, Packet, Delta);
+                bIsDelta = Delta.Num() < Packet.Num();
+            }
+
+            uint32 PacketHeader = static_cast<uint32>(Bundle->PacketNumBits[PacketIdx]) << 1 | (bIsDelta ? 1 : 0);
+            Ar.SerializeIntPacked(PacketHeader);
+            WriteBytes(Ar, bIsDelta ? Delta : Packet);
+        }
+
+        return true;
+    }
+
+    bool FBundleBaselines::Decode(const TArray<uint8>& Payload, TArray<uint8>& OutSerializedBits, int32& OutNumberOfBits, uint32& OutSequence,
+                                  bool& bOutMissingBaseline) {
+        bOutMissingBaseline = false;
+
+        FMemoryReader Ar(Payload);
+        uint32 Sequence = kNoBaseline;
+        uint32 BaselineSequence = kNoBaseline;
+        uint32 NumPackets = 0;
+
+        Ar.SerializeIntPacked(Sequence);
+        Ar.SerializeIntPacked(BaselineSequence);
+        Ar.SerializeIntPacked(NumPackets);
+
+        // Every packet takes at least two bytes of the payload, so a larger count can only come from a malformed payload.
+        if (Ar.IsError() || Sequence == kNoBaseline || NumPackets > static_cast<uint32>(Ar.TotalSize() - Ar.Tell())) { return false; }
+
+        const FBaseline* Baseline = nullptr;
+        if (BaselineSequence != kNoBaseline) {
+            Baseline = Find(BaselineSequence);
+            if (Baseline == nullptr) {
+                bOutMissingBaseline = true;
+                return false;
+            }
+        }
+
+        const TArrayView<const uint8> Base = Baseline != nullptr && !Baseline->Packets.IsEmpty() ? TArrayView<const uint8>(Baseline->Packets.Last()) : TArrayView<const uint8>();
+
+        TArray<uint8>& Bytes = BytesScratch;
+        DecodedPackets.SetNum(NumPackets, EAllowShrinking::No);
+        DecodedPacketNumBits.Reset();
+
+        FNetBitWriter& Writer = FScratchArchives::GetWriter(TNumericLimits<uint16>::Max());
+        Writer.SerializeIntPacked(NumPackets);
+
+        for (uint32 PacketIdx = 0; PacketIdx < NumPackets; ++PacketIdx) {
+            uint32 PacketHeader = 0;
+            Ar.SerializeIntPacked(PacketHeader);
+            if (!ReadBytes(Ar, Bytes)) { return false; }
+
+            const int32 NumBits = static_cast<int32>(PacketHeader >> 1);
+            const int32 NumBytes = FMath::DivideAndRoundUp(NumBits, 8);
+            TArray<uint8>& Packet = DecodedPackets[PacketIdx];
+
+            // Deltas longer than the packet are rejected by the decoder before anything is allocated or written.
+            if ((PacketHeader & 1) != 0) {
+                if (!FDeltaEncoding::Decode(Base, Bytes, NumBytes, Packet)) { return false; }
+            }
+            else {
+                Packet.Reset();
+                Packet.Append(Bytes);
+            }
+
+            if (Packet.Num() != NumBytes) { return false; }
+
+            Writer.SerializeBits(Packet.GetData(), NumBits);
+            DecodedPacketNumBits.Add(NumBits);
+        }
+
+        if (Writer.IsError()) { return false; }
+
+        OutSerializedBits.Reset();
+        OutSerializedBits.Append(Writer.GetData(), static_cast<int32>(Writer.GetNumBytes()));
+        OutNumberOfBits = static_cast<int32>(Writer.GetNumBits());
+        OutSequence = Sequence;
+
+        // The baseline is only replaced once everything has been decoded, since the new bundle can land in the same slot. The buffers are swapped so the
+        // ones that were in the slot get reused for the next decode.
+        FBaseline& Decoded = Reserve(Sequence);
+        Swap(Decoded.Packets, DecodedPackets);
+        Swap(Decoded.PacketNumBits, DecodedPacketNumBits);
+
+        return true;
+    }
+
+    const FBundleBaselines::FBaseline* FBundleBaselines::Find(uint32 Sequence) const {
+        if (Sequence == kNoBaseline || Baselines.IsEmpty()) { return nullptr; }
+
+        const FBaseline& Baseline = Baselines[Sequence % kMaxBaselines];
+        return Baseline.Sequence == Sequence ? &Baseline : nullptr;
+    }
+
+    FBundleBaselines::FBaseline& FBundleBaselines::Reserve(uint32 Sequence) {
+        if (Baselines.IsEmpty()) {
+            Baselines.SetNum(kMaxBaselines);
+        }
+
+        FBaseline& Baseline = Baselines[Sequence % kMaxBaselines];
+        Baseline.Sequence = Sequence;
+
+        return Baseline;
+    }
+}
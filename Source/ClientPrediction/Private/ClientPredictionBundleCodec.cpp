@@ -0,0 +1,125 @@
+﻿#include "ClientPredictionBundleCodec.h"
+
+#include "Misc/Compression.h"
+
+#include "ClientPredictionCVars.h"
+#include "ClientPredictionStats.h"
+
+namespace ClientPrediction {
+    // Bundles are capped well below this, so anything bigger can only come from a malformed packet.
+    static constexpr int32 kMaxRawBundleSize = 1 << 16;
+
+    static FBundleCodecStats CodecStats[static_cast<uint8>(EBundleCodec::kCount)];
+
+    static FName GetFormatName(EBundleCodec Codec) {
+        switch (Codec) {
+        case EBundleCodec::kLZ4:
+            return NAME_LZ4;
+        case EBundleCodec::kZlib:
+            return NAME_Zlib;
+        case EBundleCodec::kOodle:
+            return NAME_Oodle;
+        default:
+            return NAME_None;
+        }
+    }
+
+    static void UpdateStats(EBundleCodec Codec, int32 RawSize, int32 EncodedSize, double EncodeSeconds) {
+        FBundleCodecStats& Stats = CodecStats[static_cast<uint8>(Codec)];
+        ++Stats.NumEncoded;
+        Stats.RawBytes += RawSize;
+        Stats.EncodedBytes += EncodedSize;
+        Stats.EncodeSeconds += EncodeSeconds;
+
+        switch (Codec) {
+        case EBundleCodec::kNone:
+            INC_DWORD_STAT_BY(STAT_ClientPredictionBundleBytesRaw, EncodedSize);
+            break;
+        case EBundleCodec::kLZ4:
+            INC_DWORD_STAT_BY(STAT_ClientPredictionBundleBytesInLZ4, RawSize);
+            INC_DWORD_STAT_BY(STAT_ClientPredictionBundleBytesOutLZ4, EncodedSize);
+            INC_FLOAT_STAT_BY(STAT_ClientPredictionBundleEncodeMsLZ4, EncodeSeconds * 1000.0);
+            break;
+        case EBundleCodec::kZlib:
+            INC_DWORD_STAT_BY(STAT_ClientPredictionBundleBytesInZlib, RawSize);
+            INC_DWORD_STAT_BY(STAT_ClientPredictionBundleBytesOutZlib, EncodedSize);
+            INC_FLOAT_STAT_BY(STAT_ClientPredictionBundleEncodeMsZlib, EncodeSeconds * 1000.0);
+            break;
+        case EBundleCodec::kOodle:
+            INC_DWORD_STAT_BY(STAT_ClientPredictionBundleBytesInOodle, RawSize);
+            INC_DWORD_STAT_BY(STAT_ClientPredictionBundleBytesOutOodle, EncodedSize);
+            INC_FLOAT_STAT_BY(STAT_ClientPredictionBundleEncodeMsOodle, EncodeSeconds * 1000.0);
+            break;
+        default:
+            break;
+        }
+    }
+
+    EBundleCodec FBundleCodec::GetCodec(EDataCompleteness Completeness) {
+        int32 Codec;
+        switch (Completeness) {
+        case kLow:
+            Codec = ClientPredictionLowBundleCodec;
+            break;
+        case kMedium:
+        case kFull:
+            Codec = ClientPredictionFullBundleCodec;
+            break;
+        default:
+            Codec = ClientPredictionInputBundleCodec;
+            break;
+        }
+
+        if (Codec <= static_cast<int32>(EBundleCodec::kNone) || Codec >= static_cast<int32>(EBundleCodec::kCount)) {
+            return EBundleCodec::kNone;
+        }
+
+        // Oodle is a plugin, so it might not be available. Zlib is always there.
+        const EBundleCodec Requested = static_cast<EBundleCodec>(Codec);
+        if (Requested == EBundleCodec::kOodle && !FCompression::IsFormatValid(NAME_Oodle)) {
+            return EBundleCodec::kZlib;
+        }
+
+        return Requested;
+    }
+
+    EBundleCodec FBundleCodec::Encode(EBundleCodec Codec, const TArray<uint8>& Raw, TArray<uint8>& OutEncoded) {
+        if (Codec == EBundleCodec::kNone || Raw.Num() < ClientPredictionBundleCompressionThreshold) {
+            UpdateStats(EBundleCodec::kNone, Raw.Num(), Raw.Num(), 0.0);
+            return EBundleCodec::kNone;
+        }
+
+        const double StartTime = FPlatformTime::Seconds();
+        const FName FormatName = GetFormatName(Codec);
+
+        int32 EncodedSize = FCompression::CompressMemoryBound(FormatName, Raw.Num());
+        OutEncoded.SetNumUninitialized(EncodedSize, EAllowShrinking::No);
+
+        const bool bEncoded = FCompression::CompressMemory(FormatName, OutEncoded.GetData(), EncodedSize, Raw.GetData(), Raw.Num());
+        const double EncodeSeconds = FPlatformTime::Seconds() - StartTime;
+
+        // Small payloads can grow once the framing of the codec is added, in which case the raw bytes are sent instead.
+        if (!bEncoded || EncodedSize >= Raw.Num()) {
+            UpdateStats(EBundleCodec::kNone, Raw.Num(), Raw.Num(), EncodeSeconds);
+            return EBundleCodec::kNone;
+        }
+
+        OutEncoded.SetNum(EncodedSize, EAllowShrinking::No);
+        UpdateStats(Codec, Raw.Num(), EncodedSize, EncodeSeconds);
+
+        return Codec;
+    }
+
+    bool FBundleCodec::Decode(EBundleCodec Codec, const TArray<uint8>& Encoded, int32 RawSize, TArray<uint8>& OutRaw) {
+        const FName FormatName = GetFormatName(Codec);
+        if (FormatName == NAME_None || RawSize < 0 || RawSize > kMaxRawBundleSize) { return false; }
+
+        OutRaw.SetNumUninitialized(RawSize, EAllowShrinking::No);
+        return FCompression::UncompressMemory(FormatName, OutRaw.GetData(), RawSize, Encoded.GetData(), Encoded.Num());
+    }
+
+    const FBundleCodecStats& FBundleCodec::GetStats(EBundleCodec Codec) {
+        check(Codec < EBundleCodec::kCount);
+        return CodecStats[static_cast<uint8>(Codec)];
+    }
+}
@@ -34,11 +34,91 @@ namespace ClientPrediction {
                                                                             TEXT(
                                                                                 "If the client gets this number of ticks away from the desired sim proxy offset a correction is applied"));
 
-    CLIENTPREDICTION_API int32 ClientPredictionInputWindowSize = 3;
+    CLIENTPREDICTION_API int32 ClientPredictionInputWindowSize = 8;
     FAutoConsoleVariableRef CVarClientPredictionInputWindowSize(TEXT("cp.InputWindowSize"), ClientPredictionInputWindowSize,
-                                                                TEXT("The size of the sliding window used to send inputs"));
+                                                                TEXT("The most times an input is sent before the authority acknowledges it"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionInputMinRedundancy = 1;
+    FAutoConsoleVariableRef CVarClientPredictionInputMinRedundancy(TEXT("cp.InputMinRedundancy"), ClientPredictionInputMinRedundancy,
+                                                                   TEXT("The fewest times an input is sent before the authority acknowledges it, used when no loss is reported"));
+
+    CLIENTPREDICTION_API float ClientPredictionInputTargetMissRate = 0.01;
+    FAutoConsoleVariableRef CVarClientPredictionInputTargetMissRate(TEXT("cp.InputTargetMissRate"), ClientPredictionInputTargetMissRate,
+                                                                    TEXT("Inputs are sent enough times for the reported loss that only this fraction of them never reach the authority"));
 
     CLIENTPREDICTION_API float ClientPredictionSimProxyTickInterval = 0.1;
     FAutoConsoleVariableRef CVarClientPredictionSimProxyTickInterval(TEXT("cp.SimProxyTickInterval"), ClientPredictionSimProxyTickInterval,
                                                                      TEXT("The interval that the authority sends the latest tick to the remotes"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionHistoryKeyframeInterval = 0;
+    FAutoConsoleVariableRef CVarClientPredictionHistoryKeyframeInterval(TEXT("cp.HistoryKeyframeInterval"), ClientPredictionHistoryKeyframeInterval,
+                                                                        TEXT("If greater than 1, state histories store a full keyframe once every cp.HistoryKeyframeInterval ticks and deltas against it otherwise. Applied when a sim is created"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionHistoryWindowTicks = 16;
+    FAutoConsoleVariableRef CVarClientPredictionHistoryWindowTicks(TEXT("cp.HistoryWindowTicks"), ClientPredictionHistoryWindowTicks,
+                                                                   TEXT("The number of ticks of history kept for states that are only emitted or interpolated. This should cover the physics ticks between two game thread frames"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionCompactClientHistory = 1;
+    FAutoConsoleVariableRef CVarClientPredictionCompactClientHistory(TEXT("cp.CompactClientHistory"), ClientPredictionCompactClientHistory,
+                                                                     TEXT("If non-zero, clients store states that are only used for interpolation with single precision relative to an origin"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionStateOnlyRollback = 0;
+    FAutoConsoleVariableRef CVarClientPredictionStateOnlyRollback(TEXT("cp.StateOnlyRollback"), ClientPredictionStateOnlyRollback,
+                                                                  TEXT("If non-zero, corrections where only the state diverged replay the sim delegates instead of resimulating physics. The delegates are called without an updated component during the replay, and physics is still resimulated if Traits::ShouldResimulatePhysics (or ShouldReconcile without it) reports that the corrected state affects physics"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionPartialIslandResim = 0;
+    FAutoConsoleVariableRef CVarClientPredictionPartialIslandResim(TEXT("cp.PartialIslandResim"), ClientPredictionPartialIslandResim,
+                                                                   TEXT("If non-zero, sims whose particle isn't in an island marked for a resim skip the resimulated ticks. Only enable this if the physics solver resimulates partial islands, otherwise those sims are resimulated too and skipping them loses their state"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionInputBundleCodec = 2;
+    FAutoConsoleVariableRef CVarClientPredictionInputBundleCodec(TEXT("cp.InputBundleCodec"), ClientPredictionInputBundleCodec,
+                                                                 TEXT("The codec used for input bundles. 0 = none, 1 = LZ4, 2 = zlib, 3 = Oodle (zlib if Oodle isn't available)"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionLowBundleCodec = 2;
+    FAutoConsoleVariableRef CVarClientPredictionLowBundleCodec(TEXT("cp.LowBundleCodec"), ClientPredictionLowBundleCodec,
+                                                               TEXT("The codec used for sim proxy state bundles. 0 = none, 1 = LZ4, 2 = zlib, 3 = Oodle (zlib if Oodle isn't available)"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionFullBundleCodec = 2;
+    FAutoConsoleVariableRef CVarClientPredictionFullBundleCodec(TEXT("cp.FullBundleCodec"), ClientPredictionFullBundleCodec,
+                                                                TEXT("The codec used for auto proxy and final state bundles. 0 = none, 1 = LZ4, 2 = zlib, 3 = Oodle (zlib if Oodle isn't available)"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionBundleCompressionThreshold = 64;
+    FAutoConsoleVariableRef CVarClientPredictionBundleCompressionThreshold(TEXT("cp.BundleCompressionThreshold"), ClientPredictionBundleCompressionThreshold,
+                                                                           TEXT("Bundles smaller than this many bytes are sent without compression"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionSimProxyBaselineDelta = 1;
+    FAutoConsoleVariableRef CVarClientPredictionSimProxyBaselineDelta(TEXT("cp.SimProxyBaselineDelta"), ClientPredictionSimProxyBaselineDelta,
+                                                                      TEXT("If non-zero, sim proxy state bundles are sent as deltas against the newest bundle each client acknowledged. Applied when a sim is created"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionMaxBundleBytes = 800;
+    FAutoConsoleVariableRef CVarClientPredictionMaxBundleBytes(TEXT("cp.MaxBundleBytes"), ClientPredictionMaxBundleBytes,
+                                                               TEXT("The largest a bundle can be before it is split (inputs and events) or has its oldest states dropped (states). This should stay below the max packet size of the net driver minus headers so bundles aren't sent as partial bunches"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionLowRotationBits = 11;
+    FAutoConsoleVariableRef CVarClientPredictionLowRotationBits(TEXT("cp.LowRotationBits"), ClientPredictionLowRotationBits,
+                                                                TEXT("The bits used for each of the three smallest quaternion components of sim proxy states, between 6 and 16"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionSimProxyCompleteness = 0;
+    FAutoConsoleVariableRef CVarClientPredictionSimProxyCompleteness(TEXT("cp.SimProxyCompleteness"), ClientPredictionSimProxyCompleteness,
+                                                                     TEXT("The completeness of states sent to sim proxies. 0 = low, 1 = medium (quantized below the reconcile tolerances), 2 = full"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionAutoProxyCompleteness = 2;
+    FAutoConsoleVariableRef CVarClientPredictionAutoProxyCompleteness(TEXT("cp.AutoProxyCompleteness"), ClientPredictionAutoProxyCompleteness,
+                                                                      TEXT("The completeness of states sent to auto proxies. 0 = low, 1 = medium (quantized below the reconcile tolerances), 2 = full. Auto proxies reconcile against these states, so only lower this if every predicted field is included"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionFinalStateCompleteness = 2;
+    FAutoConsoleVariableRef CVarClientPredictionFinalStateCompleteness(TEXT("cp.FinalStateCompleteness"), ClientPredictionFinalStateCompleteness,
+                                                                       TEXT("The completeness of the final state of a sim. 0 = low, 1 = medium (quantized below the reconcile tolerances), 2 = full"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionEventChannel = 1;
+    FAutoConsoleVariableRef CVarClientPredictionEventChannel(TEXT("cp.EventChannel"), ClientPredictionEventChannel,
+                                                             TEXT("If non-zero, unreliable events are batched per connection and sent through its connection channel instead of the multicast of each sim"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionEventRedundancy = 3;
+    FAutoConsoleVariableRef CVarClientPredictionEventRedundancy(TEXT("cp.EventRedundancy"), ClientPredictionEventRedundancy,
+                                                                TEXT("The most batches an unreliable event is sent in before the client acknowledges it"));
+
+    CLIENTPREDICTION_API int32 ClientPredictionAsyncBundleDecode = 0;
+    FAutoConsoleVariableRef CVarClientPredictionAsyncBundleDecode(TEXT("cp.AsyncBundleDecode"), ClientPredictionAsyncBundleDecode,
+                                                                  TEXT("If non-zero, sim proxy state bundles are decompressed and decoded on worker threads instead of the game and physics threads. The NetSerialize function of every sim has to be thread-safe. Applied when a sim is created"));
 }
@@ -0,0 +1,162 @@
+﻿#include "ClientPredictionConnectionChannel.h"
+
+#include "Engine/NetConnection.h"
+
+#include "ClientPredictionCVars.h"
+#include "ClientPredictionV2Component.h"
+
+TMap<UWorld*, AClientPredictionConnectionChannel*> AClientPredictionConnectionChannel::LocalChannels;
+
+AClientPredictionConnectionChannel* AClientPredictionConnectionChannel::LocalChannelForWorld(const UWorld* World) {
+    if (!LocalChannels.Contains(World)) { return nullptr; }
+    return LocalChannels[World];
+}
+
+AClientPredictionConnectionChannel::AClientPredictionConnectionChannel() {
+    bReplicates = true;
+    bOnlyRelevantToOwner = true;
+
+    PrimaryActorTick.bCanEverTick = true;
+    PrimaryActorTick.TickGroup = TG_PostPhysics;
+}
+
+void AClientPredictionConnectionChannel::PostInitProperties() {
+    Super::PostInitProperties();
+    SetReplicateMovement(false);
+}
+
+void AClientPredictionConnectionChannel::BeginPlay() {
+    Super::BeginPlay();
+
+    // The copy on the owning client sends acks and the copy on the server sends events.
+    if (GetLocalRole() == ROLE_Authority) { return; }
+
+    LocalChannels.Add(GetWorld(), this);
+}
+
+void AClientPredictionConnectionChannel::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+    Super::EndPlay(EndPlayReason);
+
+    if (LocalChannelForWorld(GetWorld()) == this) {
+        LocalChannels.Remove(GetWorld());
+    }
+}
+
+void AClientPredictionConnectionChannel::Tick(float DeltaSeconds) {
+    Super::Tick(DeltaSeconds);
+
+    if (GetLocalRole() == ROLE_Authority) {
+        SendEvents();
+        return;
+    }
+
+    if (bEventsAckPending) {
+        ServerRecvEventsAck(LatestEventSequence, ReceivedEventsMask);
+        bEventsAckPending = false;
+    }
+
+    if (PendingAcks.IsEmpty()) { return; }
+
+    TArray<FClientPredictionBundleAck> Acks;
+    for (const auto& PendingAck : PendingAcks) {
+        if (!PendingAck.Key.IsValid()) { continue; }
+        Acks.Add({PendingAck.Key.Get(), PendingAck.Value});
+    }
+
+    PendingAcks.Reset();
+    if (!Acks.IsEmpty()) {
+        ServerRecvAcks(Acks);
+    }
+}
+
+void AClientPredictionConnectionChannel::QueueAck(UClientPredictionV2Component* Component, uint32 Sequence) {
+    PendingAcks.Add(Component, Sequence);
+}
+
+void AClientPredictionConnectionChannel::QueueEvents(UClientPredictionV2Component* Component, const FBundledPackets& Bundle) {
+    const UNetConnection* Connection = GetNetConnection();
+    AActor* ComponentOwner = Component != nullptr ? Component->GetOwner() : nullptr;
+    if (Connection == nullptr || ComponentOwner == nullptr || Connection->FindActorChannelRef(ComponentOwner) == nullptr) { return; }
+
+    // Events are only executed on sim proxies, so the connection that controls the sim doesn't need them.
+    if (ComponentOwner->GetNetConnection() == Connection && ComponentOwner->GetRemoteRole() == ROLE_AutonomousProxy) { return; }
+
+    UnackedEvents.Add({Component, Bundle, NextEventSequence++});
+}
+
+void AClientPredictionConnectionChannel::SendEvents() {
+    // Unacknowledged events are resent until they have gone out cp.EventRedundancy times. A frame's events can be split over several RPCs, so the client
+    // acknowledges exactly which sequences it received rather than everything up to the newest one.
+    const int32 Redundancy = FMath::Max(ClientPrediction::ClientPredictionEventRedundancy, 1);
+    UnackedEvents.RemoveAll([&](const FQueuedEvents& Events) { return !Events.Component.IsValid() || Events.NumSends >= Redundancy; });
+    if (UnackedEvents.IsEmpty()) { return; }
+
+    // Batches are kept under cp.MaxBundleBytes the same way state bundles are. Each sim's bundle was already split to fit, so one that is too large on
+    // its own still goes out in a batch by itself.
+    const int32 MaxBatchBytes = ClientPrediction::ClientPredictionMaxBundleBytes;
+
+    TArray<FClientPredictionEventBundle> Bundles;
+    int32 BatchBytes = 0;
+    for (FQueuedEvents& Events : UnackedEvents) {
+        const int32 EventsBytes = Events.Bundle.Bundle().GetNumBytes();
+        if (!Bundles.IsEmpty() && BatchBytes + EventsBytes > MaxBatchBytes) {
+            ClientRecvUnreliableEvents(Bundles);
+            Bundles.Reset();
+            BatchBytes = 0;
+        }
+
+        Bundles.Add({Events.Component.Get(), Events.Sequence, Events.Bundle});
+        BatchBytes += EventsBytes;
+        ++Events.NumSends;
+    }
+
+    ClientRecvUnreliableEvents(Bundles);
+}
+
+bool AClientPredictionConnectionChannel::MarkEventsReceived(uint32 Sequence) {
+    static constexpr int32 kMaskBits = sizeof(ReceivedEventsMask) * 8;
+
+    const int32 Age = static_cast<int32>(LatestEventSequence - Sequence);
+    if (Age < 0) {
+        ReceivedEventsMask = -Age < kMaskBits ? (ReceivedEventsMask << -Age) | 1 : 1;
+        LatestEventSequence = Sequence;
+        return true;
+    }
+
+    if (Age >= kMaskBits) { return false; }
+
+    const uint64 SequenceBit = uint64{1} << Age;
+    if (ReceivedEventsMask & SequenceBit) { return false; }
+
+    ReceivedEventsMask |= SequenceBit;
+    return true;
+}
+
+void AClientPredictionConnectionChannel::ClientRecvUnreliableEvents_Implementation(const TArray<FClientPredictionEventBundle>& Bundles) {
+    // Copies that were already received still need to be acknowledged, since the ack that was sent for them might have been lost.
+    bEventsAckPending = true;
+
+    for (const FClientPredictionEventBundle& Events : Bundles) {
+        if (!MarkEventsReceived(Events.Sequence) || Events.Component == nullptr) { continue; }
+        Events.Component->ConsumeEvents(Events.Bundle);
+    }
+}
+
+void AClientPredictionConnectionChannel::ServerRecvEventsAck_Implementation(uint32 LatestSequence, uint64 ReceivedMask) {
+    static constexpr int32 kMaskBits = sizeof(ReceivedMask) * 8;
+
+    UnackedEvents.RemoveAll([&](const FQueuedEvents& Events) {
+        const int32 Age = static_cast<int32>(LatestSequence - Events.Sequence);
+        return Age >= 0 && Age < kMaskBits && (ReceivedMask & (uint64{1} << Age)) != 0;
+    });
+}
+
+void AClientPredictionConnectionChannel::ServerRecvAcks_Implementation(const TArray<FClientPredictionBundleAck>& Acks) {
+    const UNetConnection* Connection = GetNetConnection();
+    if (Connection == nullptr) { return; }
+
+    for (const FClientPredictionBundleAck& Ack : Acks) {
+        if (Ack.Component == nullptr) { continue; }
+        Ack.Component->ConsumeSimProxyStatesAck(Connection->PackageMap, Ack.Sequence);
+    }
+}
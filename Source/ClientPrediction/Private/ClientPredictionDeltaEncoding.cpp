@@ -0,0 +1,116 @@
+﻿#include "ClientPredictionDeltaEncoding.h"
+
+#include "Misc/AutomationTest.h"
+
+namespace ClientPrediction {
+    static void WriteVarInt(uint32 Value, TArray<uint8>& Out) {
+        do {
+            uint8 Byte = Value & 0x7F;
+            Value >>= 7;
+
+            if (Value != 0) { Byte |= 0x80; }
+            Out.Add(Byte);
+        }
+        while (Value != 0);
+    }
+
+    static bool ReadVarInt(TArrayView<const uint8> In, int32& Offset, uint32& OutValue) {
+        OutValue = 0;
+        for (int32 Shift = 0; Shift < 35; Shift += 7) {
+            if (Offset >= In.Num()) { return false; }
+
+            const uint8 Byte = In[Offset++];
+            OutValue |= static_cast<uint32>(Byte & 0x7F) << Shift;
+
+            if ((Byte & 0x80) == 0) { return true; }
+        }
+
+        return false;
+    }
+
+    static uint8 XorByte(TArrayView<const uint8> Base, TArrayView<const uint8> Value, int32 Index) {
+        const uint8 BaseByte = Index < Base.Num() ? Base[Index] : 0;
+        return Value[Index] ^ BaseByte;
+    }
+
+    void FDeltaEncoding::Encode(TArrayView<const uint8> Base, TArrayView<const uint8> Value, TArray<uint8>& OutDelta) {
+        // The delta is the length of the value followed by pairs of (number of matching bytes, number of differing bytes, the differing bytes XOR the base).
+        OutDelta.Reset();
+        WriteVarInt(Value.Num(), OutDelta);
+
+        int32 Index = 0;
+        while (Index < Value.Num()) {
+            const int32 ZeroStart = Index;
+            while (Index < Value.Num() && XorByte(Base, Value, Index) == 0) { ++Index; }
+
+            const int32 LiteralStart = Index;
+            while (Index < Value.Num() && XorByte(Base, Value, Index) != 0) { ++Index; }
+
+            WriteVarInt(LiteralStart - ZeroStart, OutDelta);
+            WriteVarInt(Index - LiteralStart, OutDelta);
+
+            for (int32 LiteralIndex = LiteralStart; LiteralIndex < Index; ++LiteralIndex) {
+                OutDelta.Add(XorByte(Base, Value, LiteralIndex));
+            }
+        }
+    }
+
+    bool FDeltaEncoding::Decode(TArrayView<const uint8> Base, TArrayView<const uint8> Delta, int32 MaxValueLength, TArray<uint8>& OutValue) {
+        int32 Offset = 0;
+        uint32 ValueLength = 0;
+        if (!ReadVarInt(Delta, Offset, ValueLength)) { return false; }
+        if (MaxValueLength < 0 || ValueLength > static_cast<uint32>(MaxValueLength)) { return false; }
+
+        OutValue.SetNumUninitialized(static_cast<int32>(ValueLength), EAllowShrinking::No);
+
+        int32 Index = 0;
+        while (Index < OutValue.Num()) {
+            uint32 ZeroRun = 0;
+            uint32 LiteralRun = 0;
+            if (!ReadVarInt(Delta, Offset, ZeroRun) || !ReadVarInt(Delta, Offset, LiteralRun)) { return false; }
+
+            // The runs come from the wire, so they are checked against what is left without adding them together where they could wrap around.
+            const uint32 Remaining = ValueLength - static_cast<uint32>(Index);
+            if (ZeroRun + LiteralRun == 0 || ZeroRun > Remaining || LiteralRun > Remaining - ZeroRun) { return false; }
+            if (LiteralRun > static_cast<uint32>(Delta.Num() - Offset)) { return false; }
+
+            for (uint32 Run = 0; Run < ZeroRun; ++Run, ++Index) {
+                OutValue[Index] = Index < Base.Num() ? Base[Index] : 0;
+            }
+
+            for (uint32 Run = 0; Run < LiteralRun; ++Run, ++Index) {
+                const uint8 BaseByte = Index < Base.Num() ? Base[Index] : 0;
+                OutValue[Index] = Delta[Offset++] ^ BaseByte;
+            }
+        }
+
+        return true;
+    }
+}
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClientPredictionDeltaEncodingTest, "ClientPrediction.DeltaEncoding",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClientPredictionDeltaEncodingTest::RunTest(const FString& Parameters) {
+    using ClientPrediction::FDeltaEncoding;
+
+    const TArray<uint8> Base = {1, 2, 3, 4, 5, 6};
+    const TArray<uint8> Value = {1, 2, 9, 4, 5, 6, 7};
+
+    TArray<uint8> Delta;
+    FDeltaEncoding::Encode(Base, Value, Delta);
+
+    TArray<uint8> Decoded;
+    TestTrue(TEXT("A delta decodes back to its value"), FDeltaEncoding::Decode(Base, Delta, Value.Num(), Decoded) && Decoded == Value);
+    TestFalse(TEXT("A value longer than the maximum is rejected"), FDeltaEncoding::Decode(Base, Delta, Value.Num() - 1, Decoded));
+
+    // A 4 byte value with a zero run of 0xFFFFFFFF and a literal run of 2. Adding the runs up wraps around to fit in the value.
+    const TArray<uint8> WrappingDelta = {0x04, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0x02, 0xAA, 0xBB};
+    TestFalse(TEXT("Runs that wrap around the value length are rejected"), FDeltaEncoding::Decode(Base, WrappingDelta, 4, Decoded));
+
+    return true;
+}
+
+#endif
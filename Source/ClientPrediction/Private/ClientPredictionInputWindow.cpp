@@ -0,0 +1,219 @@
+﻿#include "ClientPredictionInputWindow.h"
+
+#include "ClientPredictionCVars.h"
+#include "ClientPredictionDeltaEncoding.h"
+
+bool FInputAck::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
+    Ar << AckedTick;
+    Ar << LossRate;
+
+    bOutSuccess = !Ar.IsError();
+    return true;
+}
+
+bool FInputAck::Identical(const FInputAck* Other, uint32 PortFlags) const {
+    return AckedTick == Other->AckedTick && LossRate == Other->LossRate;
+}
+
+namespace ClientPrediction {
+    // Anything longer than these can only come from a malformed bundle.
+    static constexpr uint32 kMaxRunLength = 1024;
+    static constexpr uint32 kMaxInputBits = 1 << 13;
+
+    static int32 NumBytesForBits(int32 NumBits) { return (NumBits + 7) >> 3; }
+
+    void FEncodedInput::EncodeDelta(const FEncodedInput* Previous) {
+        bHasDelta = Previous != nullptr && Previous->ServerTick == ServerTick - 1;
+        if (bHasDelta) {
+            FDeltaEncoding::Encode(Previous->Bytes, Bytes, Delta);
+        }
+        else {
+            Delta.Reset();
+        }
+    }
+
+    void FInputRun::NetSerialize(FArchive& Ar, FInputWindowContext* Context) {
+        check(Context != nullptr);
+        const bool bHasPrevious = Context->bHasPrevious;
+
+        if (!bHasPrevious) {
+            Ar << Context->Sequence;
+        }
+
+        // The first run of a bundle has the base tick, every other run usually starts right after the previous one.
+        uint8 bContiguous = Ar.IsSaving() && bHasPrevious && FirstTick == Context->PrevEndTick + 1;
+        Ar.SerializeBits(&bContiguous, 1);
+
+        if (bContiguous) {
+            if (!bHasPrevious) {
+                Ar.SetError();
+                return;
+            }
+
+            FirstTick = Context->PrevEndTick + 1;
+        }
+        else {
+            Ar << FirstTick;
+        }
+
+        uint32 PackedNumTicks = static_cast<uint32>(NumTicks - 1);
+        Ar.SerializeIntPacked(PackedNumTicks);
+
+        if (Ar.IsLoading()) {
+            if (PackedNumTicks >= kMaxRunLength || FirstTick > MAX_int32 - static_cast<int32>(kMaxRunLength)) {
+                Ar.SetError();
+                return;
+            }
+
+            NumTicks = static_cast<int32>(PackedNumTicks) + 1;
+        }
+
+        // Inputs of the same type almost always serialize to the same number of bits.
+        uint8 bSameNumBits = Ar.IsSaving() && bHasPrevious && NumBits == Context->PrevNumBits;
+        Ar.SerializeBits(&bSameNumBits, 1);
+
+        if (bSameNumBits) {
+            if (!bHasPrevious) {
+                Ar.SetError();
+                return;
+            }
+
+            NumBits = Context->PrevNumBits;
+        }
+        else {
+            uint32 PackedNumBits = static_cast<uint32>(NumBits);
+            Ar.SerializeIntPacked(PackedNumBits);
+
+            if (Ar.IsLoading() && PackedNumBits > kMaxInputBits) {
+                Ar.SetError();
+                return;
+            }
+
+            NumBits = static_cast<int32>(PackedNumBits);
+        }
+
+        // A run that starts right after the previous one is sent as a delta against it when that is smaller, usually only a few bytes differ.
+        uint8 bIsDelta = Ar.IsSaving() && bContiguous && Input->bHasDelta && Input->Delta.Num() * 8 < NumBits;
+        Ar.SerializeBits(&bIsDelta, 1);
+
+        if (Ar.IsSaving()) {
+            if (bIsDelta) {
+                uint32 NumDeltaBytes = static_cast<uint32>(Input->Delta.Num());
+                Ar.SerializeIntPacked(NumDeltaBytes);
+                Ar.Serialize(const_cast<uint8*>(Input->Delta.GetData()), NumDeltaBytes);
+            }
+            else {
+                Ar.SerializeBits(const_cast<uint8*>(Input->Bytes.GetData()), NumBits);
+            }
+        }
+        else {
+            TArray<uint8>& Decoded = Context->DecodedScratch;
+
+            if (bIsDelta) {
+                uint32 NumDeltaBytes = 0;
+                Ar.SerializeIntPacked(NumDeltaBytes);
+
+                if (!bContiguous || Ar.IsError() || NumDeltaBytes * 8 >= static_cast<uint32>(NumBits)) {
+                    Ar.SetError();
+                    return;
+                }
+
+                Context->DeltaScratch.SetNumUninitialized(static_cast<int32>(NumDeltaBytes), EAllowShrinking::No);
+                Ar.Serialize(Context->DeltaScratch.GetData(), NumDeltaBytes);
+
+                // The decoder rejects anything longer than the run before writing it, so a malicious delta can't make it write past what the run can
+                // hold. A shorter value is still malformed, since the run is read as NumBits from the decoded bytes.
+                const TArrayView<const uint8> PrevBytes(Context->ReceivedBytes.GetData() + Context->PrevBytesOffset, NumBytesForBits(Context->PrevNumBits));
+                const int32 NumBytes = NumBytesForBits(NumBits);
+                if (Ar.IsError() || !FDeltaEncoding::Decode(PrevBytes, Context->DeltaScratch, NumBytes, Decoded) || Decoded.Num() != NumBytes) {
+                    Ar.SetError();
+                    return;
+                }
+            }
+            else {
+                Decoded.SetNumZeroed(NumBytesForBits(NumBits), EAllowShrinking::No);
+                Ar.SerializeBits(Decoded.GetData(), NumBits);
+            }
+
+            BytesOffset = Context->ReceivedBytes.Num();
+            Context->ReceivedBytes.Append(Decoded);
+            Context->PrevBytesOffset = BytesOffset;
+        }
+
+        Context->bHasPrevious = true;
+        Context->PrevEndTick = FirstTick + NumTicks - 1;
+        Context->PrevNumBits = NumBits;
+        Context->PrevInput = Input;
+    }
+
+    void FInputWindowContext::BeginBundle() {
+        bHasPrevious = false;
+        PrevEndTick = INDEX_NONE;
+        PrevNumBits = 0;
+        PrevInput = nullptr;
+        PrevBytesOffset = INDEX_NONE;
+        ReceivedBytes.Reset();
+    }
+
+    TArrayView<const uint8> FInputWindowContext::GetBytes(const FInputRun& Run) const {
+        return TArrayView<const uint8>(ReceivedBytes.GetData() + Run.BytesOffset, NumBytesForBits(Run.NumBits));
+    }
+
+    void FInputWindowContext::BuildRuns(TArrayView<const FEncodedInput> Window, TArray<FInputRun>& OutRuns) {
+        for (const FEncodedInput& Input : Window) {
+            if (!OutRuns.IsEmpty()) {
+                FInputRun& LastRun = OutRuns.Last();
+                if (LastRun.FirstTick + LastRun.NumTicks == Input.ServerTick && LastRun.NumTicks < static_cast<int32>(kMaxRunLength) &&
+                    LastRun.Input->IsSameInput(Input)) {
+                    ++LastRun.NumTicks;
+                    continue;
+                }
+            }
+
+            FInputRun& Run = OutRuns.AddDefaulted_GetRef();
+            Run.FirstTick = Input.ServerTick;
+            Run.NumTicks = 1;
+            Run.Input = &Input;
+            Run.NumBits = Input.NumBits;
+        }
+    }
+
+    // Each bundle moves the estimate this far towards whether it followed a lost bundle or not, which averages over roughly the last 32 bundles.
+    static constexpr float kLossSmoothing = 1.0 / 32.0;
+
+    void FInputLossEstimator::ReceiveSequence(uint8 Sequence) {
+        if (!LastSequence.IsSet()) {
+            LastSequence = Sequence;
+            return;
+        }
+
+        // Split bundles repeat the last sequence and bundles that arrive out of order look like a huge gap, neither says anything about loss.
+        const uint8 Gap = Sequence - LastSequence.GetValue();
+        if (Gap == 0 || Gap > TNumericLimits<uint8>::Max() / 2) { return; }
+
+        for (uint8 Lost = 1; Lost < Gap; ++Lost) {
+            LossRate += (1.0 - LossRate) * kLossSmoothing;
+        }
+
+        LossRate -= LossRate * kLossSmoothing;
+        LastSequence = Sequence;
+    }
+
+    uint8 FInputLossEstimator::GetLossRate() const {
+        return static_cast<uint8>(FMath::RoundToInt(FMath::Clamp(LossRate, 0.0f, 1.0f) * TNumericLimits<uint8>::Max()));
+    }
+
+    int32 FInputLossEstimator::GetRedundancy(uint8 LossRate) {
+        const int32 MinRedundancy = FMath::Max(1, ClientPredictionInputMinRedundancy);
+        const int32 MaxRedundancy = FMath::Max(MinRedundancy, ClientPredictionInputWindowSize);
+        if (LossRate == 0) { return MinRedundancy; }
+        if (LossRate == TNumericLimits<uint8>::Max()) { return MaxRedundancy; }
+
+        // An input is only missed if every bundle it was sent in is lost, which happens at a rate of Loss^Redundancy.
+        const float Loss = static_cast<float>(LossRate) / TNumericLimits<uint8>::Max();
+        const float TargetMissRate = FMath::Clamp(ClientPredictionInputTargetMissRate, UE_KINDA_SMALL_NUMBER, 1.0f);
+        const int32 Redundancy = FMath::CeilToInt(FMath::Loge(TargetMissRate) / FMath::Loge(Loss));
+
+        return FMath::Clamp(Redundancy, MinRedundancy, MaxRedundancy);
+    }
+}
@@ -23,3 +23,59 @@ bool FBundledPacketsFull::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOu
 bool FBundledPacketsFull::Identical(const FBundledPacketsFull* Other, uint32 PortFlags) const {
     return Impl.Identical(&Other->Impl, PortFlags);
 }
+
+
+namespace ClientPrediction {
+    // Bundles are capped well below this, so anything bigger can only come from a malformed packet.
+    static constexpr int32 kMaxSerializedBytes = 1 << 16;
+
+    void FScratchBitReader::Reset(TArrayView<const uint8> Data, int64 NumBits) {
+        NumBits = FMath::Clamp<int64>(NumBits, 0, static_cast<int64>(Data.Num()) * 8);
+
+        Buffer.Reset();
+        Buffer.Append(Data.GetData(), static_cast<int32>((NumBits + 7) >> 3));
+
+        Num = NumBits;
+        Pos = 0;
+        ClearError();
+    }
+
+    FNetBitWriter& FScratchArchives::GetWriter(int64 MaxBits) {
+        static thread_local TOptional<FNetBitWriter> Writer;
+        static thread_local int64 WriterMaxBits = 0;
+
+        if (!Writer.IsSet() || WriterMaxBits < MaxBits) {
+            Writer.Emplace(nullptr, MaxBits);
+            WriterMaxBits = MaxBits;
+        }
+        else {
+            Writer->Reset();
+        }
+
+        return Writer.GetValue();
+    }
+
+    FScratchBitReader& FScratchArchives::GetReader(TArrayView<const uint8> Data, int64 NumBits) {
+        static thread_local FScratchBitReader Reader;
+
+        Reader.Reset(Data, NumBits);
+        return Reader;
+    }
+
+    void SerializeByteArray(FArchive& Ar, TArray<uint8>& Bytes) {
+        int32 NumBytes = Bytes.Num();
+        Ar << NumBytes;
+
+        if (Ar.IsLoading()) {
+            if (Ar.IsError() || NumBytes < 0 || NumBytes > kMaxSerializedBytes) {
+                Ar.SetError();
+                Bytes.Reset();
+                return;
+            }
+
+            Bytes.SetNumUninitialized(NumBytes, EAllowShrinking::No);
+        }
+
+        Ar.Serialize(Bytes.GetData(), NumBytes);
+    }
+}
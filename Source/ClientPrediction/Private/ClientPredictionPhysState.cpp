@@ -7,7 +7,8 @@ namespace ClientPrediction {
         if (State.ObjectState != ObjectState) { return true; }
         if ((State.X - X).Size() > ClientPredictionPositionTolerance) { return true; }
         if ((State.V - V).Size() > ClientPredictionVelocityTolerance) { return true; }
-        if ((State.R - R).Size() > ClientPredictionRotationTolerance) { return true; }
+        // Q and -Q are the same rotation, and serialized rotations can come back with either sign.
+        if (FMath::Min((State.R - R).Size(), (State.R + R).Size()) > ClientPredictionRotationTolerance) { return true; }
         if ((State.W - W).Size() > ClientPredictionAngularVelTolerance) { return true; }
 
         return false;
@@ -17,7 +18,8 @@ namespace ClientPrediction {
         ObjectState = Other.ObjectState;
         X = FMath::Lerp(FVector(X), FVector(Other.X), Alpha);
         V = FMath::Lerp(FVector(V), FVector(Other.V), Alpha);
-        R = FMath::Lerp(FQuat(R), FQuat(Other.R), Alpha);
+        // Q and -Q are the same rotation, a plain lerp between them would pass through zero. Slerp takes the shortest path and returns a unit quaternion.
+        R = FQuat::Slerp(FQuat(R), FQuat(Other.R), Alpha);
         W = FMath::Lerp(FVector(W), FVector(Other.W), Alpha);
     }
 
@@ -29,21 +31,162 @@ namespace ClientPrediction {
         R = Chaos::FRotation3::IntegrateRotationWithAngularVelocity(R, AngularVelocity, ExtrapolationTime);
     }
 
-    void FPhysState::NetSerialize(FArchive& Ar, EDataCompleteness Completeness) {
-        if (Completeness == EDataCompleteness::kLow) {
-            SerializePackedVector<10, 24>(X, Ar);
+    // Positions are quantized to a tenth of a unit, which is the same precision the packed vector used before anchors.
+    static constexpr Chaos::FReal kLowPositionScale = 10.0;
+
+    static uint64 ZigZag(int64 Value) { return (static_cast<uint64>(Value) << 1) ^ static_cast<uint64>(Value >> 63); }
+    static int64 UnZigZag(uint64 Value) { return static_cast<int64>(Value >> 1) ^ -static_cast<int64>(Value & 1); }
+
+    // kMedium steps are powers of two so that they are exact on both ends. The range goes from far finer than anything needs to above any sane tolerance.
+    static constexpr int32 kMinStepExponent = -32;
+    static constexpr int32 kMaxStepExponent = 31;
+
+    static int32 StepExponentForTolerance(float Tolerance) {
+        if (!(Tolerance > 0.0f)) { return kMinStepExponent; }
+        return FMath::Clamp(FMath::FloorToInt(FMath::Log2(Tolerance)), kMinStepExponent, kMaxStepExponent);
+    }
+
+    static void SerializeQuantizedVector(Chaos::FVec3& Vector, FArchive& Ar, int32 StepExponent) {
+        const Chaos::FReal Step = FMath::Pow(2.0, static_cast<Chaos::FReal>(StepExponent));
+
+        for (int32 Axis = 0; Axis < 3; ++Axis) {
+            uint64 Packed = Ar.IsSaving() ? ZigZag(FMath::RoundToInt64(Vector[Axis] / Step)) : 0;
+            Ar.SerializeIntPacked64(Packed);
+
+            if (Ar.IsLoading()) {
+                Vector[Axis] = static_cast<Chaos::FReal>(UnZigZag(Packed)) * Step;
+            }
+        }
+    }
+
+    /**
+     * Writes the three smallest components of the quaternion, each quantized to NumBits, and the index of the largest one. The largest one is rebuilt from
+     * the others since the quaternion is normalized, and its sign is always made positive since Q and -Q are the same rotation.
+     */
+    static void SerializeSmallestThree(Chaos::FRotation3& R, FArchive& Ar, int32 NumBits) {
+        // With the largest component removed, the other three are within +-1/sqrt(2).
+        static constexpr double kComponentRange = UE_INV_SQRT_2;
+        const uint32 MaxQuantized = (1u << NumBits) - 1;
+
+        uint32 LargestIndex = 0;
+        uint32 Quantized[3] = {};
+
+        if (Ar.IsSaving()) {
+            const Chaos::FRotation3 Normalized = R.GetNormalized();
+            const double Components[4] = {Normalized.X, Normalized.Y, Normalized.Z, Normalized.W};
+
+            for (uint32 Index = 1; Index < 4; ++Index) {
+                if (FMath::Abs(Components[Index]) > FMath::Abs(Components[LargestIndex])) { LargestIndex = Index; }
+            }
+
+            const double Sign = Components[LargestIndex] < 0.0 ? -1.0 : 1.0;
+            for (uint32 Index = 0, Written = 0; Index < 4; ++Index) {
+                if (Index == LargestIndex) { continue; }
+
+                const double Normalized01 = (Components[Index] * Sign / kComponentRange) * 0.5 + 0.5;
+                Quantized[Written++] = static_cast<uint32>(FMath::Clamp<int64>(FMath::RoundToInt64(Normalized01 * MaxQuantized), 0, MaxQuantized));
+            }
+        }
+
+        Ar.SerializeInt(LargestIndex, 4);
+        for (uint32& Component : Quantized) {
+            Ar.SerializeInt(Component, MaxQuantized + 1);
+        }
+
+        if (Ar.IsLoading()) {
+            double Components[4] = {};
+            double SumSquares = 0.0;
+
+            for (uint32 Index = 0, Read = 0; Index < 4; ++Index) {
+                if (Index == LargestIndex) { continue; }
+
+                Components[Index] = (static_cast<double>(Quantized[Read++]) / MaxQuantized * 2.0 - 1.0) * kComponentRange;
+                SumSquares += Components[Index] * Components[Index];
+            }
+
+            Components[LargestIndex] = FMath::Sqrt(FMath::Max(0.0, 1.0 - SumSquares));
+
+            R = Chaos::FRotation3(Components[0], Components[1], Components[2], Components[3]);
+            R.Normalize();
+        }
+    }
+
+    void FPhysState::SerializeLow(FArchive& Ar, FPhysStateAnchor& Anchor) {
+        const bool bIsAnchor = !Anchor.bIsSet;
+        if (bIsAnchor) {
+            uint32 RotationBits = static_cast<uint32>(FMath::Clamp(ClientPredictionLowRotationBits, kMinRotationBits, kMaxRotationBits));
+            Ar.SerializeInt(RotationBits, kMaxRotationBits + 1);
 
-            FRotator Rotator{};
-            if (Ar.IsSaving()) {
-                Rotator = R.Rotator();
+            if (RotationBits < kMinRotationBits) {
+                Ar.SetError();
+                return;
             }
 
-            Rotator.SerializeCompressedShort(Ar);
+            Anchor.RotationBits = static_cast<int32>(RotationBits);
+        }
+
+        for (int32 Axis = 0; Axis < 3; ++Axis) {
+            int64 QuantizedX = Ar.IsSaving() ? FMath::RoundToInt64(X[Axis] * kLowPositionScale) : 0;
+
+            uint64 Packed = ZigZag(bIsAnchor ? QuantizedX : QuantizedX - Anchor.QuantizedX[Axis]);
+            Ar.SerializeIntPacked64(Packed);
 
             if (Ar.IsLoading()) {
-                R = Rotator.Quaternion();
+                QuantizedX = bIsAnchor ? UnZigZag(Packed) : UnZigZag(Packed) + Anchor.QuantizedX[Axis];
+                X[Axis] = static_cast<Chaos::FReal>(QuantizedX) / kLowPositionScale;
+            }
+
+            if (bIsAnchor) {
+                Anchor.QuantizedX[Axis] = QuantizedX;
+            }
+        }
+
+        Anchor.bIsSet = true;
+        SerializeSmallestThree(R, Ar, Anchor.RotationBits);
+    }
+
+    void FPhysState::SerializeMedium(FArchive& Ar, FPhysStateAnchor& Anchor) {
+        if (!Anchor.bHasMediumSteps) {
+            const float Tolerances[3] = {ClientPredictionPositionTolerance, ClientPredictionVelocityTolerance, ClientPredictionAngularVelTolerance};
+            for (int32 Index = 0; Index < 3; ++Index) {
+                uint32 BiasedExponent = static_cast<uint32>(StepExponentForTolerance(Tolerances[Index]) - kMinStepExponent);
+                Ar.SerializeInt(BiasedExponent, kMaxStepExponent - kMinStepExponent + 1);
+                Anchor.MediumStepExponents[Index] = static_cast<int32>(BiasedExponent) + kMinStepExponent;
+            }
+
+            // The three components are at most 1/sqrt(2) apart from their quantized values by half a step each, which adds up to about two steps for the
+            // whole quaternion. The bits are picked so that stays below the rotation tolerance.
+            const float RotationTolerance = FMath::Max(ClientPredictionRotationTolerance, UE_KINDA_SMALL_NUMBER);
+            uint32 RotationBits = static_cast<uint32>(FMath::Clamp(FMath::CeilToInt(FMath::Log2(2.0f * UE_SQRT_2 / RotationTolerance)), kMinRotationBits,
+                                                                   kMaxRotationBits));
+            Ar.SerializeInt(RotationBits, kMaxRotationBits + 1);
+
+            if (RotationBits < kMinRotationBits) {
+                Ar.SetError();
+                return;
             }
 
+            Anchor.MediumRotationBits = static_cast<int32>(RotationBits);
+            Anchor.bHasMediumSteps = true;
+        }
+
+        Ar << ObjectState;
+
+        SerializeQuantizedVector(X, Ar, Anchor.MediumStepExponents[0]);
+        SerializeQuantizedVector(V, Ar, Anchor.MediumStepExponents[1]);
+        SerializeSmallestThree(R, Ar, Anchor.MediumRotationBits);
+        SerializeQuantizedVector(W, Ar, Anchor.MediumStepExponents[2]);
+    }
+
+    void FPhysState::NetSerialize(FArchive& Ar, EDataCompleteness Completeness, FPhysStateAnchor* Anchor) {
+        FPhysStateAnchor LocalAnchor{};
+        if (Completeness == EDataCompleteness::kLow) {
+            SerializeLow(Ar, Anchor != nullptr ? *Anchor : LocalAnchor);
+            return;
+        }
+
+        if (Completeness == EDataCompleteness::kMedium) {
+            SerializeMedium(Ar, Anchor != nullptr ? *Anchor : LocalAnchor);
             return;
         }
 
@@ -67,4 +210,39 @@ namespace ClientPrediction {
         Ar << W.Y;
         Ar << W.Z;
     }
+
+    void FPhysState::SerializeCompact(FArchive& Ar, const Chaos::FVec3& Origin) {
+        uint8 PackedObjectState = static_cast<uint8>(ObjectState);
+        FVector3f Offset = Ar.IsSaving() ? FVector3f(X - Origin) : FVector3f::ZeroVector;
+        FVector3f CompactV = Ar.IsSaving() ? FVector3f(V) : FVector3f::ZeroVector;
+        FVector3f CompactW = Ar.IsSaving() ? FVector3f(W) : FVector3f::ZeroVector;
+
+        int16 PackedR[4] = {};
+        if (Ar.IsSaving()) {
+            const Chaos::FRotation3 NormalizedR = R.GetNormalized();
+            PackedR[0] = static_cast<int16>(FMath::RoundToInt(NormalizedR.X * MAX_int16));
+            PackedR[1] = static_cast<int16>(FMath::RoundToInt(NormalizedR.Y * MAX_int16));
+            PackedR[2] = static_cast<int16>(FMath::RoundToInt(NormalizedR.Z * MAX_int16));
+            PackedR[3] = static_cast<int16>(FMath::RoundToInt(NormalizedR.W * MAX_int16));
+        }
+
+        Ar << PackedObjectState;
+        Ar << Offset;
+        Ar << CompactV;
+        Ar << PackedR[0];
+        Ar << PackedR[1];
+        Ar << PackedR[2];
+        Ar << PackedR[3];
+        Ar << CompactW;
+
+        if (Ar.IsLoading()) {
+            ObjectState = static_cast<Chaos::EObjectStateType>(PackedObjectState);
+            X = Origin + Chaos::FVec3(Offset);
+            V = Chaos::FVec3(CompactV);
+            W = Chaos::FVec3(CompactW);
+
+            R = Chaos::FRotation3(PackedR[0], PackedR[1], PackedR[2], PackedR[3]);
+            R.Normalize();
+        }
+    }
 }
@@ -1,9 +1,67 @@
 ﻿#include "ClientPredictionSimEvents.h"
 
 namespace ClientPrediction {
+    int32 FEventTypeIndex::Allocate() {
+        static int32 NextTypeIndex = 0;
+        return FPlatformAtomics::InterlockedIncrement(&NextTypeIndex) - 1;
+    }
+
+    void FEventQueue::Add(TUniquePtr<FEventWrapperBase> Event) {
+        // Only predicted events have a local tick. Events from the authority are never checked for duplicates.
+        if (Event->LocalTick != INDEX_NONE) {
+            PredictedEvents.Add(MakeKey(*Event), Event.Get());
+        }
+
+        Pending.HeapPush(FPendingEvent{Event->ExecutionTime, NextOrder++, Event.Get()});
+        Events.Emplace(MoveTemp(Event));
+        ++NumUnemitted;
+    }
+
+    void FEventQueue::ExecuteDue(Chaos::FReal Time) {
+        while (!Pending.IsEmpty() && Pending.HeapTop().ExecutionTime <= Time) {
+            FPendingEvent Due{};
+            Pending.HeapPop(Due, EAllowShrinking::No);
+            Due.Event->Execute();
+        }
+    }
+
+    void FEventQueue::Prune(Chaos::FReal HistoryStartTime) {
+        // Events are only pruned once they are done with. One that is still pending holds up the ones behind it, but only until it executes.
+        while (!Events.IsEmpty()) {
+            FEventWrapperBase& Oldest = *Events.First();
+            if ((!Oldest.bHasExecuted && !Oldest.bIsCancelled) || Oldest.ExecutionTime >= HistoryStartTime) { break; }
+
+            if (Oldest.LocalTick != INDEX_NONE) {
+                PredictedEvents.RemoveSingle(MakeKey(Oldest), &Oldest);
+            }
+
+            Events.PopFront();
+        }
+
+        NumUnemitted = FMath::Min(NumUnemitted, Events.Num());
+    }
+
+    void FEventQueue::Rewind(int32 LocalRewindTick) {
+        // Only events that haven't executed are removed, and those are all pending. They stay in the history as cancelled until they are pruned.
+        const int32 NumRemoved = Pending.RemoveAll([&](const FPendingEvent& PendingEvent) {
+            if (PendingEvent.Event->LocalTick < LocalRewindTick) { return false; }
+
+            // A cancelled event can never be a duplicate, so it doesn't need to stay indexed.
+            PendingEvent.Event->bIsCancelled = true;
+            PredictedEvents.RemoveSingle(MakeKey(*PendingEvent.Event), PendingEvent.Event);
+            return true;
+        });
+
+        if (NumRemoved > 0) {
+            Pending.Heapify();
+        }
+    }
+
     void USimEvents::ConsumeEvents(const FBundledPackets& Packets, Chaos::FReal SimDt) {
+        FCountedScopeLock EventLock(&EventMutex);
+
         TArray<FEventLoader> AuthorityEvents;
-        Packets.Bundle().Retrieve(AuthorityEvents, FEventLoaderUserdata{Factories, SimDt});
+        Packets.Bundle().Retrieve(AuthorityEvents, FEventLoaderUserdata{Factories, Queue, SimDt});
     }
 
     void USimEvents::ConsumeRemoteSimProxyOffset(const FRemoteSimProxyOffset& Offset) {
@@ -11,7 +69,7 @@ namespace ClientPrediction {
     }
 
     void USimEvents::PreparePrePhysics(const FNetTickInfo& TickInfo) {
-        FScopeLock EventLock(&EventMutex);
+        FCountedScopeLock EventLock(&EventMutex);
 
         // These are emitted over a reliable RPC, so the order is guaranteed. No need to keep track of which offset has been acked.
         FRemoteSimProxyOffset NewRemoteSimProxyOffset{};
@@ -25,36 +83,45 @@ namespace ClientPrediction {
     }
 
     void USimEvents::ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole) {
-        FScopeLock EventLock(&EventMutex);
-        for (auto& FactoryPair : Factories) {
-            FactoryPair.Value->ExecuteEvents(ResultsTime, SimProxyOffset, SimRole, HistoryDuration);
-        }
+        FCountedScopeLock EventLock(&EventMutex);
+
+        const Chaos::FReal AdjustedResultsTime = SimRole != ROLE_SimulatedProxy ? ResultsTime : ResultsTime + SimProxyOffset;
+        Queue.ExecuteDue(AdjustedResultsTime);
+        Queue.Prune(AdjustedResultsTime - HistoryDuration);
     }
 
     void USimEvents::Rewind(int32 LocalRewindTick) {
-        FScopeLock EventLock(&EventMutex);
-        for (auto& FactoryPair : Factories) {
-            FactoryPair.Value->Rewind(LocalRewindTick);
-        }
+        FCountedScopeLock EventLock(&EventMutex);
+        Queue.Rewind(LocalRewindTick);
     }
 
     void USimEvents::EmitEvents() {
-        FScopeLock EventLock(&EventMutex);
+        FCountedScopeLock EventLock(&EventMutex);
 
-        TArray<FEventSaver> Serializers;
+        TArray<FEventSaver> ReliableSerializers;
+        TArray<FEventSaver> UnreliableSerializers;
         const int32 CurrentLatestEmittedTick = LatestEmittedTick;
 
-        for (auto& FactoryPair : Factories) {
-            const int32 FactoryNewestEvent = FactoryPair.Value->EmitEvents(CurrentLatestEmittedTick, Serializers);
-            LatestEmittedTick = FMath::Max(FactoryNewestEvent, LatestEmittedTick);
-        }
+        Queue.ForEachUnemitted([&](FEventWrapperBase& Event) {
+            if (Event.bIsCancelled || Event.ServerTick <= CurrentLatestEmittedTick) { return; }
+
+            LatestEmittedTick = FMath::Max(Event.ServerTick, LatestEmittedTick);
+
+            TArray<FEventSaver>& Serializers = Event.Delivery == EEventDelivery::kReliable ? ReliableSerializers : UnreliableSerializers;
+            Serializers.Add(FEventSaver(Event));
+        });
+
+        EmitBundles(ReliableSerializers, EEventDelivery::kReliable);
+        EmitBundles(UnreliableSerializers, EEventDelivery::kUnreliable);
+    }
 
+    void USimEvents::EmitBundles(TArray<FEventSaver>& Serializers, EEventDelivery Delivery) {
         if (Serializers.IsEmpty()) {
             return;
         }
 
+        // Bundles that had to be split can each be decoded on their own, so it doesn't matter if unreliable ones arrive out of order or not at all.
         FBundledPackets EventPackets{};
-        EventPackets.Bundle().Store(Serializers, this);
-        EmitEventBundle.ExecuteIfBound(EventPackets);
+        EventPackets.Bundle().StoreSplit(Serializers, this, [&]() { EmitEventBundle.ExecuteIfBound(EventPackets, Delivery); });
     }
 }
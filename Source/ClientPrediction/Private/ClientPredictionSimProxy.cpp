@@ -1,8 +1,10 @@
 ﻿#include "ClientPredictionSimProxy.h"
 
+#include "GameFramework/PlayerController.h"
 #include "Net/UnrealNetwork.h"
 
 #include "ClientPrediction.h"
+#include "ClientPredictionConnectionChannel.h"
 #include "ClientPredictionCVars.h"
 #include "ClientPredictionUtils.h"
 
@@ -65,6 +67,33 @@ void AClientPredictionSimProxyManager::Tick(float DeltaSeconds) {
     if (PhysSolver == nullptr) { return; }
 
     LatestServerTick = PhysSolver->GetCurrentFrame();
+    UpdateConnectionChannels();
+}
+
+void AClientPredictionSimProxyManager::UpdateConnectionChannels() {
+    for (auto It = ConnectionChannels.CreateIterator(); It; ++It) {
+        if (It.Key().IsValid()) { continue; }
+
+        if (It.Value().IsValid()) {
+            It.Value()->Destroy();
+        }
+
+        It.RemoveCurrent();
+    }
+
+    if (!ClientPrediction::ClientPredictionSimProxyBaselineDelta && !ClientPrediction::ClientPredictionEventChannel) { return; }
+
+    UWorld* World = GetWorld();
+    for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It) {
+        APlayerController* PlayerController = It->Get();
+        if (PlayerController == nullptr || PlayerController->IsLocalController() || ConnectionChannels.Contains(PlayerController)) { continue; }
+
+        FActorSpawnParameters SpawnParameters{};
+        SpawnParameters.Owner = PlayerController;
+        SpawnParameters.ObjectFlags |= EObjectFlags::RF_Transient;
+
+        ConnectionChannels.Add(PlayerController, World->SpawnActor<AClientPredictionConnectionChannel>(SpawnParameters));
+    }
 }
 
 int32 AClientPredictionSimProxyManager::GetLocalToServerOffset() const {
@@ -77,6 +106,17 @@ const TOptional<FRemoteSimProxyOffset>& AClientPredictionSimProxyManager::GetRem
     return RemoteSimProxyOffset;
 }
 
+bool AClientPredictionSimProxyManager::QueueEvents(UClientPredictionV2Component* Component, const FBundledPackets& Bundle) {
+    if (ConnectionChannels.IsEmpty()) { return false; }
+
+    for (const auto& ConnectionChannel : ConnectionChannels) {
+        if (!ConnectionChannel.Value.IsValid()) { continue; }
+        ConnectionChannel.Value->QueueEvents(Component, Bundle);
+    }
+
+    return true;
+}
+
 void AClientPredictionSimProxyManager::LatestServerTickChangedGT() {
     if (!HasActorBegunPlay()) { return; }
 
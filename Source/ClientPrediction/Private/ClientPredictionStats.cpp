@@ -0,0 +1,23 @@
+﻿#include "ClientPredictionStats.h"
+
+DEFINE_STAT(STAT_ClientPredictionStatesPublished);
+DEFINE_STAT(STAT_ClientPredictionStatesConsumed);
+DEFINE_STAT(STAT_ClientPredictionLockWaits);
+DEFINE_STAT(STAT_ClientPredictionCompressionCacheHits);
+DEFINE_STAT(STAT_ClientPredictionCompressionCacheMisses);
+DEFINE_STAT(STAT_ClientPredictionBundleBytesRaw);
+DEFINE_STAT(STAT_ClientPredictionBundleBytesInLZ4);
+DEFINE_STAT(STAT_ClientPredictionBundleBytesOutLZ4);
+DEFINE_STAT(STAT_ClientPredictionBundleEncodeMsLZ4);
+DEFINE_STAT(STAT_ClientPredictionBundleBytesInZlib);
+DEFINE_STAT(STAT_ClientPredictionBundleBytesOutZlib);
+DEFINE_STAT(STAT_ClientPredictionBundleEncodeMsZlib);
+DEFINE_STAT(STAT_ClientPredictionBundleBytesInOodle);
+DEFINE_STAT(STAT_ClientPredictionBundleBytesOutOodle);
+DEFINE_STAT(STAT_ClientPredictionBundleEncodeMsOodle);
+DEFINE_STAT(STAT_ClientPredictionBaselineKeyframes);
+DEFINE_STAT(STAT_ClientPredictionBaselineDeltas);
+DEFINE_STAT(STAT_ClientPredictionBundlesSplit);
+DEFINE_STAT(STAT_ClientPredictionBundlePacketsDropped);
+DEFINE_STAT(STAT_ClientPredictionResimTicksSkipped);
+DEFINE_STAT(STAT_ClientPredictionStateHistoryMemory);
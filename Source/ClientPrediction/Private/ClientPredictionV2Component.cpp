@@ -2,6 +2,9 @@
 
 #include "Net/UnrealNetwork.h"
 
+#include "ClientPredictionConnectionChannel.h"
+#include "ClientPredictionSimProxy.h"
+
 UClientPredictionV2Component::UClientPredictionV2Component() {
     SetIsReplicatedByDefault(true);
     bWantsInitializeComponent = true;
@@ -15,6 +18,7 @@ UClientPredictionV2Component::~UClientPredictionV2Component() {}
 void UClientPredictionV2Component::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const {
     Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
+    DOREPLIFETIME_CONDITION(UClientPredictionV2Component, InputAck, COND_AutonomousOnly);
     DOREPLIFETIME_CONDITION(UClientPredictionV2Component, SimProxyStates, COND_SimulatedOnly);
     DOREPLIFETIME_CONDITION(UClientPredictionV2Component, AutoProxyStates, COND_AutonomousOnly);
     DOREPLIFETIME(UClientPredictionV2Component, FinalState);
@@ -25,6 +29,14 @@ void UClientPredictionV2Component::InitializeComponent() {
 
     UpdatedComponent = Cast<UPrimitiveComponent>(GetOwner()->GetRootComponent());
     check(UpdatedComponent);
+
+    if (ClientPrediction::ClientPredictionSimProxyBaselineDelta) {
+        SimProxyStates.Bundle().EnableBaselines();
+    }
+
+    if (ClientPrediction::ClientPredictionAsyncBundleDecode) {
+        SimProxyStates.Bundle().DeferDecode();
+    }
 }
 
 void UClientPredictionV2Component::BeginPlay() {
@@ -65,8 +77,25 @@ void UClientPredictionV2Component::ServerRecvInput_Implementation(const FBundled
     if (SimCoordinator != nullptr) { SimCoordinator->ConsumeInputBundle(Bundle); }
 }
 
+void UClientPredictionV2Component::OnRep_InputAck() {
+    if (SimCoordinator != nullptr) { SimCoordinator->ConsumeInputAck(InputAck); }
+}
+
 void UClientPredictionV2Component::OnRep_SimProxyStates() {
     if (SimCoordinator != nullptr) { SimCoordinator->ConsumeSimProxyStates(SimProxyStates); }
+
+    // Bundles that are decoded off the game thread report their ack through the sim once they have been decoded.
+    const TOptional<uint32>& BaselineAck = SimProxyStates.Bundle().GetBaselineAck();
+    if (BaselineAck.IsSet()) { QueueSimProxyStatesAck(BaselineAck.GetValue()); }
+}
+
+void UClientPredictionV2Component::QueueSimProxyStatesAck(uint32 Sequence) {
+    AClientPredictionConnectionChannel* Channel = AClientPredictionConnectionChannel::LocalChannelForWorld(GetWorld());
+    if (Channel != nullptr) { Channel->QueueAck(this, Sequence); }
+}
+
+void UClientPredictionV2Component::ConsumeSimProxyStatesAck(const UPackageMap* Connection, uint32 Sequence) {
+    SimProxyStates.Bundle().AckBaseline(Connection, Sequence);
 }
 
 void UClientPredictionV2Component::OnRep_AutoProxyStates() {
@@ -77,10 +106,25 @@ void UClientPredictionV2Component::OnRep_FinalState() {
     if (SimCoordinator != nullptr) { SimCoordinator->ConsumeFinalState(FinalState); }
 }
 
-void UClientPredictionV2Component::ClientRecvEvents_Implementation(const FBundledPackets& Bundle) {
+void UClientPredictionV2Component::EmitEvents(const FBundledPackets& Bundle, ClientPrediction::EEventDelivery Delivery) {
+    // Reliable events always go through the reliable multicast so that they are only delivered once the actor can be resolved and stay in order with
+    // the rest of its RPCs. Unreliable events can be batched with the other sims of each connection.
+    if (Delivery == ClientPrediction::EEventDelivery::kUnreliable && ClientPrediction::ClientPredictionEventChannel) {
+        AClientPredictionSimProxyManager* Manager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
+        if (Manager != nullptr && Manager->QueueEvents(this, Bundle)) { return; }
+    }
+
+    ClientRecvEvents(Bundle);
+}
+
+void UClientPredictionV2Component::ConsumeEvents(const FBundledPackets& Bundle) {
     if (SimCoordinator != nullptr) { SimCoordinator->ConsumeEvents(Bundle); }
 }
 
+void UClientPredictionV2Component::ClientRecvEvents_Implementation(const FBundledPackets& Bundle) {
+    ConsumeEvents(Bundle);
+}
+
 void UClientPredictionV2Component::ServerRecvRemoteSimProxyOffset_Implementation(const FRemoteSimProxyOffset& Offset) {
     if (SimCoordinator != nullptr) { SimCoordinator->ConsumeRemoteSimProxyOffset(Offset); }
 }
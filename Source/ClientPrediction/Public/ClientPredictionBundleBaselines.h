@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+class UPackageMap;
+
+namespace ClientPrediction {
+    /**
+     * Remembers the packets of recent bundles so that new bundles can be sent as deltas against a bundle the receiver already has. The authority tracks
+     * which bundle each connection acknowledged last and the receiver keeps the bundles it decoded. A bundle is sent as a keyframe whenever there is no
+     * acknowledged bundle that both sides still know about, which covers late joiners and bundles that were lost.
+     */
+    class CLIENTPREDICTION_API FBundleBaselines {
+    public:
+        static constexpr uint32 kNoBaseline = 0;
+        static constexpr int32 kMaxBaselines = 32;
+
+        /** Remembers the packets of a bundle. PacketEndBits contains the bit offset of the end of each packet in SerializedBits. */
+        void Add(uint32 Sequence, const TArray<uint8>& SerializedBits, int32 NumberOfBits, const TArray<int32>& PacketEndBits);
+
+        /** Records that a connection received the bundle with Sequence. Acknowledging kNoBaseline makes the next bundle to that connection a keyframe. */
+        void Ack(const UPackageMap* Connection, uint32 Sequence);
+
+        /** Returns the sequence of the bundle that should be used as a baseline for a connection, or kNoBaseline if a keyframe needs to be sent. */
+        uint32 GetBaselineSequence(const UPackageMap* Connection) const;
+
+        /** Writes the bundle with Sequence relative to BaselineSequence. Returns false if the bundle isn't known. */
+        bool Encode(uint32 Sequence, uint32 BaselineSequence, TArray<uint8>& OutPayload) const;
+
+        /**
+         * Rebuilds the bits of a bundle from a payload written by Encode and remembers it so it can be used as a baseline. Returns false if the payload is
+         * malformed or if its baseline is no longer known, in which case bOutMissingBaseline is set.
+         */
+        bool Decode(const TArray<uint8>& Payload, TArray<uint8>& OutSerializedBits, int32& OutNumberOfBits, uint32& OutSequence, bool& bOutMissingBaseline);
+
+    private:
+        struct FBaseline {
+            uint32 Sequence = kNoBaseline;
+            TArray<TArray<uint8>> Packets;
+            TArray<int32> PacketNumBits;
+        };
+
+        const FBaseline* Find(uint32 Sequence) const;
+        FBaseline& Reserve(uint32 Sequence);
+
+        TArray<FBaseline> Baselines;
+        TMap<TWeakObjectPtr<const UPackageMap>, uint32> AckedSequences;
+
+        // Reused between calls so that encoding and decoding don't allocate once these have grown large enough.
+        mutable TArray<uint8> DeltaScratch;
+        TArray<uint8> BytesScratch;
+        TArray<TArray<uint8>> DecodedPackets;
+        TArray<int32> DecodedPacketNumBits;
+    };
+}
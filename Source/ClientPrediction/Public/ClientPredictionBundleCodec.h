@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+#include "ClientPredictionDataCompleteness.h"
+
+namespace ClientPrediction {
+    enum class EBundleCodec : uint8 {
+        kNone = 0,
+        kLZ4,
+        kZlib,
+        kOodle,
+        kCount
+    };
+
+    /** Totals for everything encoded with a codec since startup. */
+    struct FBundleCodecStats {
+        uint64 NumEncoded = 0;
+        uint64 RawBytes = 0;
+        uint64 EncodedBytes = 0;
+        double EncodeSeconds = 0.0;
+
+        double GetRatio() const { return RawBytes != 0 ? static_cast<double>(EncodedBytes) / static_cast<double>(RawBytes) : 1.0; }
+    };
+
+    struct CLIENTPREDICTION_API FBundleCodec {
+        /** The codec configured for bundles of the given completeness. kCount is used for input bundles. */
+        static EBundleCodec GetCodec(EDataCompleteness Completeness);
+
+        /**
+         * Encodes Raw with Codec. Returns the codec that was actually used, which is kNone if Raw is below cp.BundleCompressionThreshold or if encoding
+         * didn't make it any smaller. OutEncoded may have been used as scratch space in that case, so its contents are unspecified and the caller
+         * has to fill it with the raw bytes itself.
+         */
+        static EBundleCodec Encode(EBundleCodec Codec, const TArray<uint8>& Raw, TArray<uint8>& OutEncoded);
+        static bool Decode(EBundleCodec Codec, const TArray<uint8>& Encoded, int32 RawSize, TArray<uint8>& OutRaw);
+
+        static const FBundleCodecStats& GetStats(EBundleCodec Codec);
+    };
+}
@@ -15,6 +15,31 @@ namespace ClientPrediction {
     extern CLIENTPREDICTION_API int32 ClientPredictionSimProxyCorrectionThreshold;
 
     extern CLIENTPREDICTION_API int32 ClientPredictionInputWindowSize;
+    extern CLIENTPREDICTION_API int32 ClientPredictionInputMinRedundancy;
+    extern CLIENTPREDICTION_API float ClientPredictionInputTargetMissRate;
 
     extern CLIENTPREDICTION_API float ClientPredictionSimProxyTickInterval;
+
+    extern CLIENTPREDICTION_API int32 ClientPredictionHistoryKeyframeInterval;
+    extern CLIENTPREDICTION_API int32 ClientPredictionHistoryWindowTicks;
+    extern CLIENTPREDICTION_API int32 ClientPredictionCompactClientHistory;
+    extern CLIENTPREDICTION_API int32 ClientPredictionStateOnlyRollback;
+    extern CLIENTPREDICTION_API int32 ClientPredictionPartialIslandResim;
+
+    extern CLIENTPREDICTION_API int32 ClientPredictionInputBundleCodec;
+    extern CLIENTPREDICTION_API int32 ClientPredictionLowBundleCodec;
+    extern CLIENTPREDICTION_API int32 ClientPredictionFullBundleCodec;
+    extern CLIENTPREDICTION_API int32 ClientPredictionBundleCompressionThreshold;
+    extern CLIENTPREDICTION_API int32 ClientPredictionSimProxyBaselineDelta;
+    extern CLIENTPREDICTION_API int32 ClientPredictionMaxBundleBytes;
+    extern CLIENTPREDICTION_API int32 ClientPredictionLowRotationBits;
+
+    extern CLIENTPREDICTION_API int32 ClientPredictionSimProxyCompleteness;
+    extern CLIENTPREDICTION_API int32 ClientPredictionAutoProxyCompleteness;
+    extern CLIENTPREDICTION_API int32 ClientPredictionFinalStateCompleteness;
+
+    extern CLIENTPREDICTION_API int32 ClientPredictionEventChannel;
+    extern CLIENTPREDICTION_API int32 ClientPredictionEventRedundancy;
+
+    extern CLIENTPREDICTION_API int32 ClientPredictionAsyncBundleDecode;
 }
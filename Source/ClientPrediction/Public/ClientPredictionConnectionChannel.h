@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+#include "ClientPredictionNetSerialization.h"
+
+#include "ClientPredictionConnectionChannel.generated.h"
+
+USTRUCT()
+struct FClientPredictionBundleAck {
+    GENERATED_BODY()
+
+    UPROPERTY()
+    class UClientPredictionV2Component* Component = nullptr;
+
+    UPROPERTY()
+    uint32 Sequence = 0;
+};
+
+USTRUCT()
+struct FClientPredictionEventBundle {
+    GENERATED_BODY()
+
+    UPROPERTY()
+    class UClientPredictionV2Component* Component = nullptr;
+
+    /** Used to drop copies that were already received and to acknowledge them. */
+    UPROPERTY()
+    uint32 Sequence = 0;
+
+    UPROPERTY()
+    FBundledPackets Bundle;
+};
+
+/**
+ * Sim proxies are not owned by the client that sees them, so they can't send anything to the server. The server spawns one of these for every player
+ * controller, owned by it, which clients use to acknowledge the state bundles they received for all sim proxies.
+ *
+ * The server also sends the unreliable events of every sim that is relevant to the connection through it, batched into as few RPCs per frame as
+ * cp.MaxBundleBytes allows. Each event is repeated in up to cp.EventRedundancy batches until the client acknowledges it. Reliable events stay on the
+ * reliable multicast of their component, since they need to be delivered in order with the actor they belong to.
+ */
+UCLASS()
+class CLIENTPREDICTION_API AClientPredictionConnectionChannel : public AActor {
+    GENERATED_BODY()
+
+    static TMap<class UWorld*, AClientPredictionConnectionChannel*> LocalChannels;
+
+public:
+    static AClientPredictionConnectionChannel* LocalChannelForWorld(const class UWorld* World);
+
+    AClientPredictionConnectionChannel();
+    virtual void PostInitProperties() override;
+
+    virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    virtual void Tick(float DeltaSeconds) override;
+
+    /** Acks are sent once per frame, only the newest one for each component is kept. */
+    void QueueAck(class UClientPredictionV2Component* Component, uint32 Sequence);
+
+    /** Queues unreliable events to be sent with the next batch. Events of sims that aren't relevant to the connection or that it controls are skipped. */
+    void QueueEvents(class UClientPredictionV2Component* Component, const FBundledPackets& Bundle);
+
+private:
+    void SendEvents();
+    bool MarkEventsReceived(uint32 Sequence);
+
+    UFUNCTION(Server, Unreliable)
+    void ServerRecvAcks(const TArray<FClientPredictionBundleAck>& Acks);
+
+    UFUNCTION(Client, Unreliable)
+    void ClientRecvUnreliableEvents(const TArray<FClientPredictionEventBundle>& Bundles);
+
+    UFUNCTION(Server, Unreliable)
+    void ServerRecvEventsAck(uint32 LatestSequence, uint64 ReceivedMask);
+
+    TMap<TWeakObjectPtr<class UClientPredictionV2Component>, uint32> PendingAcks;
+
+    struct FQueuedEvents {
+        TWeakObjectPtr<class UClientPredictionV2Component> Component;
+        FBundledPackets Bundle;
+        uint32 Sequence = 0;
+        int32 NumSends = 0;
+    };
+
+    // Relevant only for the authority
+    TArray<FQueuedEvents> UnackedEvents;
+    uint32 NextEventSequence = 1;
+
+    // Relevant only for the owning client. Bit N of ReceivedEventsMask is set if LatestEventSequence - N was received.
+    uint32 LatestEventSequence = 0;
+    uint64 ReceivedEventsMask = 0;
+    bool bEventsAckPending = false;
+};
@@ -3,9 +3,20 @@
 #include "CoreMinimal.h"
 
 namespace ClientPrediction {
+    /**
+     * How much of a state is sent. Each role gets the completeness of its CVar: sim proxies cp.SimProxyCompleteness (kLow by default), auto proxies
+     * cp.AutoProxyCompleteness and final states cp.FinalStateCompleteness (both kFull by default). Auto proxies reconcile against what they receive, so
+     * anything they predict has to be included in their completeness. Inputs are always sent with kCount.
+     */
     enum CLIENTPREDICTION_API EDataCompleteness : uint8 {
         kLow = 0,
+        kMedium,
         kFull,
         kCount
     };
+
+    /** The completeness set by a cp.*Completeness CVar, out of range values are clamped. */
+    inline EDataCompleteness CompletenessFromCVar(int32 Value) {
+        return static_cast<EDataCompleteness>(FMath::Clamp(Value, 0, static_cast<int32>(kCount) - 1));
+    }
 }
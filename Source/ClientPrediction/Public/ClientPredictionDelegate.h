@@ -20,7 +20,8 @@ namespace ClientPrediction {
 
         /**
          * Dispatches an event. There will be a delay between when this function is called and when the delegate for the event is broadcasted since some physics ticks
-         * are buffered before the game thread interpolates between them. Events will be replicated reliably, so usage should be kept to a minimum.
+         * are buffered before the game thread interpolates between them. Events will be replicated reliably unless the event type opts into unreliable
+         * delivery with kDelivery, so usage of reliable events should be kept to a minimum.
          *
          * Events need to be registered first before they can be dispatched.
          * @tparam Event The event type to dispatch.
@@ -60,7 +61,8 @@ namespace ClientPrediction {
         FSimDelegates(const TSharedPtr<USimEvents>& SimEvents) : SimEvents(SimEvents) {}
 
         /**
-         * Registers an event for the simulation. The event can be dispatched in SimTickPrePhysicsDelegate or SimTickPostPhysicsDelegate.
+         * Registers an event for the simulation. The event can be dispatched in SimTickPrePhysicsDelegate or SimTickPostPhysicsDelegate. Events are
+         * identified over the network by the order they were registered in, so every machine needs to register the same events in the same order.
          * @tparam EventType The event type to register.
          * @return The delegate that will be called on the game thread when the event is dispatched.
          */
@@ -0,0 +1,19 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+namespace ClientPrediction {
+    /**
+     * Encodes a buffer as the XOR against a base buffer, with runs of zero bytes collapsed. Buffers that mostly match their base (consecutive states of
+     * the same simulation for example) encode down to a handful of bytes. The base does not need to be the same length as the value.
+     */
+    struct CLIENTPREDICTION_API FDeltaEncoding {
+        static void Encode(TArrayView<const uint8> Base, TArrayView<const uint8> Value, TArray<uint8>& OutDelta);
+
+        /**
+         * Returns false if the delta is malformed or decodes to more than MaxValueLength bytes. Deltas received from the network should pass the largest
+         * length they can legitimately have, since the length is checked before OutValue is allocated.
+         */
+        static bool Decode(TArrayView<const uint8> Base, TArrayView<const uint8> Delta, int32 MaxValueLength, TArray<uint8>& OutValue);
+    };
+}
@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+#include "ClientPredictionInputWindow.generated.h"
+
+/** Sent from the authority to the auto proxy so that it only sends inputs the authority still needs, as many times as the loss on the link calls for. */
+USTRUCT()
+struct FInputAck {
+    GENERATED_BODY()
+
+    /** The authority has every input up to and including this tick, or has already simulated the tick without it. */
+    int32 AckedTick = INDEX_NONE;
+
+    /** The fraction of input bundles that were lost on the way to the authority, scaled to 255. */
+    uint8 LossRate = 0;
+
+    bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+    bool Identical(const FInputAck* Other, uint32 PortFlags) const;
+};
+
+template <>
+struct TStructOpsTypeTraits<FInputAck> : public TStructOpsTypeTraitsBase2<FInputAck> {
+    enum {
+        WithNetSerializer = true,
+        WithIdentical = true
+    };
+};
+
+namespace ClientPrediction {
+    /** An input that was serialized once, when it was first sent. Every re-send of the input reuses these bytes. */
+    struct CLIENTPREDICTION_API FEncodedInput {
+        int32 ServerTick = INDEX_NONE;
+        int32 NumBits = 0;
+        TArray<uint8> Bytes;
+
+        /** Bytes as a delta against the input for ServerTick - 1. Only valid if bHasDelta is set. */
+        TArray<uint8> Delta;
+        bool bHasDelta = false;
+
+        /** The number of bundles the input has been sent in. */
+        int32 NumSends = 0;
+
+        /** Computes Delta against the input for the previous tick. Previous can be null if that input was never encoded. */
+        void EncodeDelta(const FEncodedInput* Previous);
+
+        bool IsSameInput(const FEncodedInput& Other) const { return NumBits == Other.NumBits && Bytes == Other.Bytes; }
+    };
+
+    struct FInputWindowContext;
+
+    /**
+     * A run of consecutive ticks that all used the same input, which is how the input window is sent. The first run of a bundle has the base tick and
+     * the full input, every run after that starts where the previous one ended and is usually sent as a delta against the input of that run.
+     */
+    struct CLIENTPREDICTION_API FInputRun {
+        int32 FirstTick = INDEX_NONE;
+        int32 NumTicks = 0;
+
+        /** The input for the run when sending. */
+        const FEncodedInput* Input = nullptr;
+
+        /** Where the bytes of the input are in FInputWindowContext::ReceivedBytes when receiving. */
+        int32 BytesOffset = 0;
+        int32 NumBits = 0;
+
+        void NetSerialize(FArchive& Ar, FInputWindowContext* Context);
+    };
+
+    /** The state shared by the runs of a bundle, passed to the bundle as userdata. */
+    struct CLIENTPREDICTION_API FInputWindowContext {
+        /** Called by the bundle before the first packet of each bundle is stored or retrieved so that every bundle can be decoded on its own. */
+        void BeginBundle();
+
+        /** Returns the bytes that a received run decoded to. */
+        TArrayView<const uint8> GetBytes(const FInputRun& Run) const;
+
+        /** Every bundle is tagged with a sequence so the receiver can tell how many were lost. Bundles that were split share a sequence. */
+        uint8 Sequence = 0;
+
+        /** Appends the runs for a window of encoded inputs. Inputs for consecutive ticks that are the same are merged into one run. */
+        static void BuildRuns(TArrayView<const FEncodedInput> Window, TArray<FInputRun>& OutRuns);
+
+    private:
+        friend struct FInputRun;
+
+        bool bHasPrevious = false;
+        int32 PrevEndTick = INDEX_NONE;
+        int32 PrevNumBits = 0;
+
+        // Sending
+        const FEncodedInput* PrevInput = nullptr;
+
+        // Receiving. The bytes of every run in the bundle are stored back to back so that receiving doesn't allocate in steady state.
+        TArray<uint8> ReceivedBytes;
+        int32 PrevBytesOffset = INDEX_NONE;
+        TArray<uint8> DeltaScratch;
+        TArray<uint8> DecodedScratch;
+    };
+
+    /** Estimates the loss rate of input bundles from the gaps in their sequences. */
+    struct CLIENTPREDICTION_API FInputLossEstimator {
+        void ReceiveSequence(uint8 Sequence);
+        uint8 GetLossRate() const;
+
+        /** The number of times each input should be sent so that an input is only missed at the rate of cp.InputTargetMissRate. */
+        static int32 GetRedundancy(uint8 LossRate);
+
+    private:
+        TOptional<uint8> LastSequence;
+        float LossRate = 0.0;
+    };
+}
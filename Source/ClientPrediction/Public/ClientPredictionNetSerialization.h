@@ -1,12 +1,36 @@
 ﻿#pragma once
 
-#include "Serialization/ArchiveLoadCompressedProxy.h"
-#include "Serialization/ArchiveSaveCompressedProxy.h"
+#include "CoreMinimal.h"
+#include "UObject/CoreNet.h"
 
+#include "ClientPredictionBundleBaselines.h"
+#include "ClientPredictionBundleCodec.h"
+#include "ClientPredictionCVars.h"
 #include "ClientPredictionDataCompleteness.h"
+#include "ClientPredictionStats.h"
 
 #include "ClientPredictionNetSerialization.generated.h"
 
+namespace ClientPrediction {
+    /** FNetBitReader copies whatever it reads into a new allocation, this keeps one buffer around and copies into it instead. */
+    class CLIENTPREDICTION_API FScratchBitReader : public FNetBitReader {
+    public:
+        void Reset(TArrayView<const uint8> Data, int64 NumBits);
+    };
+
+    /**
+     * Bit archives for the calling thread that keep their buffers between uses, so that serializing bundles doesn't allocate once the buffers have grown
+     * large enough. Only one of each can be in use on a thread at a time.
+     */
+    struct CLIENTPREDICTION_API FScratchArchives {
+        static FNetBitWriter& GetWriter(int64 MaxBits);
+        static FScratchBitReader& GetReader(TArrayView<const uint8> Data, int64 NumBits);
+    };
+
+    /** Same layout as Ar << Bytes, but Bytes keeps its allocation when loading and the size is validated before anything is allocated. */
+    CLIENTPREDICTION_API void SerializeByteArray(FArchive& Ar, TArray<uint8>& Bytes);
+}
+
 template <ClientPrediction::EDataCompleteness Completeness>
 struct FPacketBundle {
     void Copy(const FPacketBundle& Other);
@@ -14,12 +38,72 @@ struct FPacketBundle {
     template <typename Packet, typename UserdataType>
     void Store(TArray<Packet>& Packets, UserdataType Userdata);
 
+    /**
+     * Stores packets without copying them into an array first. Visit is called with a function that writes a single packet and should call it for every
+     * packet in the bundle, which can't be more than MaxPackets.
+     */
+    template <typename Packet, typename UserdataType, typename VisitorType>
+    void StoreEach(int32 MaxPackets, UserdataType Userdata, VisitorType&& Visit);
+
+    /**
+     * Like StoreEach(), but if the bundle would be larger than cp.MaxBundleBytes the oldest packets are dropped until it fits. This is meant for bundles
+     * that are replicated as properties, where only the latest value is ever sent and the newest packets are the ones that matter.
+     */
+    template <typename Packet, typename UserdataType, typename VisitorType>
+    void StoreNewest(int32 MaxPackets, UserdataType Userdata, VisitorType&& Visit);
+
+    /**
+     * Stores Packets in as many bundles as it takes to keep each one under cp.MaxBundleBytes and calls Emit after each one is stored. Every bundle can be
+     * retrieved on its own, so the receiver just consumes them in the order they arrive and losing one of them doesn't affect the others.
+     */
+    template <typename Packet, typename UserdataType, typename EmitType>
+    void StoreSplit(TArray<Packet>& Packets, UserdataType Userdata, EmitType&& Emit);
+
+    /** Packets are appended to the end of Packets. Passing the same array every time (after a Reset()) avoids allocating in steady state. */
     template <typename Packet, typename UserdataType>
     bool Retrieve(TArray<Packet>& Packets, UserdataType Userdata) const;
 
     bool HasData() const;
 
+    /** The size of the stored bundle, not counting the header that NetSerialize() adds. */
+    int32 GetNumBytes() const { return SerializedBits.Num(); }
+
+    /**
+     * Bundles are stored with the completeness of their type unless this is called before storing. The completeness is sent with the bundle, so the
+     * receiver always decodes with the one the sender used.
+     */
+    void SetCompleteness(ClientPrediction::EDataCompleteness NewCompleteness) { PacketCompleteness = NewCompleteness; }
+
+    /**
+     * Sends this bundle as a delta against the newest bundle each connection acknowledged. Only the authority needs to call this, receivers pick up the
+     * encoding from the bundle itself.
+     */
+    void EnableBaselines();
+    void AckBaseline(const UPackageMap* Connection, uint32 AckedSequence);
+
+    /** Set when the last bundle received was delta encoded. This is what the receiver should acknowledge, kNoBaseline asks for a keyframe. */
+    const TOptional<uint32>& GetBaselineAck() const { return BaselineAck; }
+
+    /**
+     * Makes NetSerialize() keep received payloads as they arrived instead of decompressing them and rebuilding them from their baseline, so that can be
+     * done off the game thread with DecodePayload() on a copy of the bundle. Copies share their baselines, so they need to be decoded one at a time in
+     * the order they were received.
+     */
+    void DeferDecode() { bDeferDecode = true; }
+    bool IsDecodePending() const { return bDecodePending; }
+
+    /** Decodes a payload that was kept because of DeferDecode(). Returns false if the payload was malformed. */
+    bool DecodePayload();
+
 private:
+    /** Packets can share state within a bundle through their userdata, which is reset here so that each bundle can be decoded on its own. */
+    template <typename UserdataType>
+    static void BeginBundle(UserdataType Userdata) {
+        if constexpr (requires { Userdata->BeginBundle(); }) {
+            Userdata->BeginBundle();
+        }
+    }
+
     template <typename Packet, typename UserdataType>
     void NetSerializePacket(Packet& PacketToSerialize, UserdataType Userdata, FArchive& Ar) const;
 
@@ -31,95 +115,439 @@ private:
     TArray<uint8> SerializedBits;
     int32 NumberOfBits = INDEX_NONE;
     uint64 Sequence = 0;
+
+    /** The bit offset of the end of each packet, used to split the bundle into packets that can be delta encoded individually. */
+    TArray<int32> PacketEndBits;
+
+    /** The bits taken by the packet count when the bundle was last stored. */
+    int32 HeaderBits = 0;
+
+    ClientPrediction::EDataCompleteness PacketCompleteness = Completeness;
+
+    TSharedPtr<ClientPrediction::FBundleBaselines> Baselines;
+    TOptional<uint32> BaselineAck;
+
+    bool bDeferDecode = false;
+    bool bDecodePending = false;
+
+    static constexpr uint8 kBaselineEncodedFlag = 0x80;
+
+    // The completeness is sent in the codec byte, between the codec and the baseline flag.
+    static constexpr uint8 kCompletenessShift = 4;
+    static constexpr uint8 kCompletenessMask = 0x30;
+    static constexpr uint8 kCodecMask = 0x0F;
+
+    struct FCompressedPayload {
+        TArray<uint8> Bytes;
+        ClientPrediction::EBundleCodec Codec = ClientPrediction::EBundleCodec::kNone;
+        uint32 RawSize = 0;
+        bool bBaselineEncoded = false;
+
+        uint64 Sequence = TNumericLimits<uint64>::Max();
+        uint32 BaselineSequence = ClientPrediction::FBundleBaselines::kNoBaseline;
+    };
+
+    /**
+     * The same bundle is serialized once for every connection it is replicated to, so the compressed bits are cached until the sequence changes. Connections
+     * that acknowledged different baselines need different payloads, so there is a slot for every baseline that can be in use. The buffers used to receive
+     * bundles live here too so they are reused between bundles. This is shared rather than copied when the bundle is copied, since its contents are only
+     * valid for the sequence they were made for anyway.
+     */
+    struct FSerializationCache {
+        TArray<FCompressedPayload> CompressedPayloads;
+        TArray<uint8> PayloadScratch;
+        FCompressedPayload ReceivedScratch;
+    };
+
+    TSharedPtr<FSerializationCache> Cache;
+
+    /** Payloads received while decoding is deferred are kept here instead of the cache, so the bundle can be copied and decoded on another thread. */
+    FCompressedPayload PendingPayload;
+
+    FSerializationCache& GetCache();
+    bool DecodeReceived(FCompressedPayload& Received);
+    FCompressedPayload& FindCompressedPayload(uint32 BaselineSequence);
+    void EncodePayload(uint32 BaselineSequence, FCompressedPayload& OutPayload);
 };
 
 template <ClientPrediction::EDataCompleteness Completeness>
 void FPacketBundle<Completeness>::Copy(const FPacketBundle& Other) {
-    SerializedBits = Other.SerializedBits;
+    SerializedBits.Reset();
+    SerializedBits.Append(Other.SerializedBits);
     NumberOfBits = Other.NumberOfBits;
+    PacketCompleteness = Other.PacketCompleteness;
+
+    PacketEndBits.Reset();
+    PacketEndBits.Append(Other.PacketEndBits);
 
     Sequence = FMath::Max(Other.Sequence, ++Sequence);
+
+    if (Baselines != nullptr && NumberOfBits != INDEX_NONE) {
+        Baselines->Add(static_cast<uint32>(Sequence), SerializedBits, NumberOfBits, PacketEndBits);
+    }
 }
 
 template <ClientPrediction::EDataCompleteness Completeness>
 template <typename Packet, typename UserdataType>
 void FPacketBundle<Completeness>::Store(TArray<Packet>& Packets, UserdataType Userdata) {
-    check(Packets.Num() < TNumericLimits<uint8>::Max());
+    StoreEach<Packet>(Packets.Num(), Userdata, [&](auto&& WritePacket) {
+        for (const Packet& PacketToWrite : Packets) {
+            WritePacket(PacketToWrite);
+        }
+    });
+}
 
-    FNetBitWriter Writer(nullptr, TNumericLimits<uint16>::Max());
-    uint8 NumPackets = static_cast<uint8>(Packets.Num());
-    Writer << NumPackets;
+template <ClientPrediction::EDataCompleteness Completeness>
+template <typename Packet, typename UserdataType, typename VisitorType>
+void FPacketBundle<Completeness>::StoreEach(int32 MaxPackets, UserdataType Userdata, VisitorType&& Visit) {
+    // Packets described by a schema have a known upper bound, so the writer only needs to be big enough for this bundle instead of for the largest possible one.
+    int64 MaxBits = TNumericLimits<uint16>::Max();
+    if constexpr (requires { Packet::GetMaxSerializedBits(Completeness); }) {
+        MaxBits = 40 + MaxPackets * Packet::GetMaxSerializedBits(PacketCompleteness);
+    }
+
+    FNetBitWriter& Writer = ClientPrediction::FScratchArchives::GetWriter(MaxBits);
+
+    // The count is packed, so it has to be known up front.
+    uint32 NumPackets = 0;
+    Visit([&](const Packet&) { ++NumPackets; });
+    check(NumPackets <= static_cast<uint32>(MaxPackets));
+
+    Writer.SerializeIntPacked(NumPackets);
+    HeaderBits = static_cast<int32>(Writer.GetNumBits());
 
-    for (Packet& PacketToWrite : Packets) {
-        NetSerializePacket(PacketToWrite, Userdata, Writer);
+    BeginBundle(Userdata);
+
+    PacketEndBits.Reset();
+    Visit([&](const Packet& PacketToWrite) {
+        // Saving doesn't modify the packet, NetSerialize() just isn't const since it is also used for loading.
+        NetSerializePacket(const_cast<Packet&>(PacketToWrite), Userdata, Writer);
+        PacketEndBits.Add(static_cast<int32>(Writer.GetNumBits()));
+    });
+
+    // The writer is only as large as the bound given by the packets, so writing more than GetMaxSerializedBits() overflows it. Nothing is stored in
+    // that case rather than sending a truncated bundle.
+    if (!ensureMsgf(!Writer.IsError(), TEXT("A bundle of %u packets overflowed its writer of %lld bits, GetMaxSerializedBits() is too small"), NumPackets, MaxBits)) {
+        SerializedBits.Reset();
+        PacketEndBits.Reset();
+        NumberOfBits = INDEX_NONE;
+        return;
     }
 
-    SerializedBits = *Writer.GetBuffer();
+    SerializedBits.Reset();
+    SerializedBits.Append(Writer.GetData(), Writer.GetNumBytes());
     NumberOfBits = Writer.GetNumBits();
     ++Sequence;
 }
 
+template <ClientPrediction::EDataCompleteness Completeness>
+template <typename Packet, typename UserdataType, typename VisitorType>
+void FPacketBundle<Completeness>::StoreNewest(int32 MaxPackets, UserdataType Userdata, VisitorType&& Visit) {
+    StoreEach<Packet>(MaxPackets, Userdata, Visit);
+
+    const int64 MaxBundleBits = static_cast<int64>(ClientPrediction::ClientPredictionMaxBundleBytes) * 8;
+    if (NumberOfBits <= MaxBundleBits || PacketEndBits.Num() <= 1) { return; }
+
+    // Find the oldest packet that can be kept. The newest packet is always kept, even if it doesn't fit on its own.
+    auto PacketStartBit = [&](int32 PacketIdx) { return PacketIdx == 0 ? HeaderBits : PacketEndBits[PacketIdx - 1]; };
+
+    const int32 NumPackets = PacketEndBits.Num();
+    int32 FirstKept = NumPackets - 1;
+    while (FirstKept > 0 && HeaderBits + PacketEndBits.Last() - PacketStartBit(FirstKept - 1) <= MaxBundleBits) {
+        --FirstKept;
+    }
+
+    // The sizes from the first pass are only an estimate, since the first kept packet starts a new bundle context (a kLow state becomes the anchor for
+    // example) and can grow. The trimmed bundle is measured once stored and trimmed further until it fits.
+    for (;;) {
+        StoreEach<Packet>(NumPackets - FirstKept, Userdata, [&](auto&& WritePacket) {
+            int32 PacketIdx = 0;
+            Visit([&](const Packet& PacketToWrite) {
+                if (PacketIdx++ >= FirstKept) { WritePacket(PacketToWrite); }
+            });
+        });
+
+        if (NumberOfBits <= MaxBundleBits || FirstKept >= NumPackets - 1) { break; }
+        ++FirstKept;
+    }
+
+    INC_DWORD_STAT_BY(STAT_ClientPredictionBundlePacketsDropped, FirstKept);
+}
+
+template <ClientPrediction::EDataCompleteness Completeness>
+template <typename Packet, typename UserdataType, typename EmitType>
+void FPacketBundle<Completeness>::StoreSplit(TArray<Packet>& Packets, UserdataType Userdata, EmitType&& Emit) {
+    Store(Packets, Userdata);
+
+    const int64 MaxBundleBits = static_cast<int64>(ClientPrediction::ClientPredictionMaxBundleBytes) * 8;
+    if (NumberOfBits <= MaxBundleBits || Packets.Num() <= 1) {
+        Emit();
+        return;
+    }
+
+    // The sizes of the packets are known from the first pass, so the packets are grouped greedily and each group is stored again as its own bundle.
+    // Each group starts a new bundle context, so its first packet can be larger than in the first pass. Groups are measured once stored and shrunk until
+    // they fit. A packet that is too large on its own still goes out in a bundle by itself.
+    const TArray<int32> AllPacketEndBits = PacketEndBits;
+    const int32 AllHeaderBits = HeaderBits;
+
+    int32 GroupStart = 0;
+    while (GroupStart < Packets.Num()) {
+        const int32 GroupStartBit = GroupStart == 0 ? AllHeaderBits : AllPacketEndBits[GroupStart - 1];
+
+        int32 GroupEnd = GroupStart + 1;
+        while (GroupEnd < Packets.Num() && AllHeaderBits + AllPacketEndBits[GroupEnd] - GroupStartBit <= MaxBundleBits) {
+            ++GroupEnd;
+        }
+
+        for (;;) {
+            StoreEach<Packet>(GroupEnd - GroupStart, Userdata, [&](auto&& WritePacket) {
+                for (int32 PacketIdx = GroupStart; PacketIdx < GroupEnd; ++PacketIdx) {
+                    WritePacket(Packets[PacketIdx]);
+                }
+            });
+
+            if (NumberOfBits <= MaxBundleBits || GroupEnd - GroupStart <= 1) { break; }
+            --GroupEnd;
+        }
+
+        INC_DWORD_STAT(STAT_ClientPredictionBundlesSplit);
+        Emit();
+
+        GroupStart = GroupEnd;
+    }
+}
+
 template <ClientPrediction::EDataCompleteness Completeness>
 template <typename Packet, typename UserdataType>
 bool FPacketBundle<Completeness>::Retrieve(TArray<Packet>& Packets, UserdataType Userdata) const {
     if (NumberOfBits == -1) { return false; }
 
-    FNetBitReader BitReader(nullptr, SerializedBits.GetData(), NumberOfBits);
-    uint8 NumPackets = 0;
-    BitReader << NumPackets;
+    FNetBitReader& BitReader = ClientPrediction::FScratchArchives::GetReader(SerializedBits, NumberOfBits);
+    uint32 NumPackets = 0;
+    BitReader.SerializeIntPacked(NumPackets);
 
-    for (uint8 PacketIdx = 0; PacketIdx < NumPackets; ++PacketIdx) {
-        Packets.AddDefaulted();
-        NetSerializePacket(Packets.Last(), Userdata, BitReader);
+    // Every packet takes at least one bit, so a larger count can only come from a malformed bundle.
+    if (BitReader.IsError() || NumPackets > static_cast<uint32>(BitReader.GetBitsLeft())) { return false; }
+
+    BeginBundle(Userdata);
+
+    Packets.Reserve(Packets.Num() + NumPackets);
+    for (uint32 PacketIdx = 0; PacketIdx < NumPackets && !BitReader.IsError(); ++PacketIdx) {
+        NetSerializePacket(Packets.AddDefaulted_GetRef(), Userdata, BitReader);
     }
 
-    return true;
+    return !BitReader.IsError();
 }
 
 template <ClientPrediction::EDataCompleteness Completeness>
 bool FPacketBundle<Completeness>::HasData() const { return NumberOfBits != INDEX_NONE; }
 
 template <ClientPrediction::EDataCompleteness Completeness>
-template <typename Packet, typename UserdataType>
-void FPacketBundle<Completeness>::NetSerializePacket(Packet& PacketToSerialize, UserdataType Userdata, FArchive& Ar) const {
-    PacketToSerialize.NetSerialize(Ar, Userdata);
+void FPacketBundle<Completeness>::EnableBaselines() {
+    if (Baselines == nullptr) {
+        Baselines = MakeShared<ClientPrediction::FBundleBaselines>();
+    }
 }
 
-template <>
-template <typename Packet, typename UserdataType>
-void FPacketBundle<ClientPrediction::EDataCompleteness::kFull>::NetSerializePacket(Packet& PacketToSerialize, UserdataType Userdata, FArchive& Ar) const {
-    PacketToSerialize.NetSerialize(Ar, ClientPrediction::EDataCompleteness::kFull, Userdata);
+template <ClientPrediction::EDataCompleteness Completeness>
+void FPacketBundle<Completeness>::AckBaseline(const UPackageMap* Connection, uint32 AckedSequence) {
+    if (Baselines != nullptr) { Baselines->Ack(Connection, AckedSequence); }
 }
 
-template <>
+template <ClientPrediction::EDataCompleteness Completeness>
+typename FPacketBundle<Completeness>::FSerializationCache& FPacketBundle<Completeness>::GetCache() {
+    if (Cache == nullptr) {
+        Cache = MakeShared<FSerializationCache>();
+    }
+
+    return *Cache;
+}
+
+template <ClientPrediction::EDataCompleteness Completeness>
+typename FPacketBundle<Completeness>::FCompressedPayload& FPacketBundle<Completeness>::FindCompressedPayload(uint32 BaselineSequence) {
+    using namespace ClientPrediction;
+
+    TArray<FCompressedPayload>& CompressedPayloads = GetCache().CompressedPayloads;
+    const int32 NumSlots = Baselines != nullptr ? FBundleBaselines::kMaxBaselines + 1 : 1;
+    if (CompressedPayloads.Num() < NumSlots) {
+        CompressedPayloads.SetNum(NumSlots);
+    }
+
+    const int32 Slot = BaselineSequence == FBundleBaselines::kNoBaseline ? 0 : 1 + BaselineSequence % FBundleBaselines::kMaxBaselines;
+    return CompressedPayloads[Slot];
+}
+
+template <ClientPrediction::EDataCompleteness Completeness>
+void FPacketBundle<Completeness>::EncodePayload(uint32 BaselineSequence, FCompressedPayload& OutPayload) {
+    using namespace ClientPrediction;
+
+    TArray<uint8>& BaselinePayload = GetCache().PayloadScratch;
+    OutPayload.bBaselineEncoded = Baselines != nullptr && Baselines->Encode(static_cast<uint32>(Sequence), BaselineSequence, BaselinePayload);
+
+    if (OutPayload.bBaselineEncoded) {
+        if (BaselineSequence == FBundleBaselines::kNoBaseline) {
+            INC_DWORD_STAT(STAT_ClientPredictionBaselineKeyframes);
+        }
+        else {
+            INC_DWORD_STAT(STAT_ClientPredictionBaselineDeltas);
+        }
+    }
+
+    const TArray<uint8>& Raw = OutPayload.bBaselineEncoded ? BaselinePayload : SerializedBits;
+    OutPayload.RawSize = static_cast<uint32>(Raw.Num());
+    OutPayload.Codec = FBundleCodec::Encode(FBundleCodec::GetCodec(Completeness), Raw, OutPayload.Bytes);
+
+    if (OutPayload.Codec == EBundleCodec::kNone) {
+        OutPayload.Bytes.Reset();
+        OutPayload.Bytes.Append(Raw);
+    }
+
+    OutPayload.Sequence = Sequence;
+    OutPayload.BaselineSequence = BaselineSequence;
+}
+
+template <ClientPrediction::EDataCompleteness Completeness>
 template <typename Packet, typename UserdataType>
-void FPacketBundle<ClientPrediction::EDataCompleteness::kLow>::NetSerializePacket(Packet& PacketToSerialize, UserdataType Userdata, FArchive& Ar) const {
-    PacketToSerialize.NetSerialize(Ar, ClientPrediction::EDataCompleteness::kLow, Userdata);
+void FPacketBundle<Completeness>::NetSerializePacket(Packet& PacketToSerialize, UserdataType Userdata, FArchive& Ar) const {
+    // Bundles without a completeness (inputs and events) don't pass one on to their packets.
+    if constexpr (Completeness == ClientPrediction::EDataCompleteness::kCount) {
+        PacketToSerialize.NetSerialize(Ar, Userdata);
+    }
+    else {
+        PacketToSerialize.NetSerialize(Ar, PacketCompleteness, Userdata);
+    }
 }
 
 template <ClientPrediction::EDataCompleteness Completeness>
 bool FPacketBundle<Completeness>::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
+    using namespace ClientPrediction;
+
+    // The codec is written first so that the receiver knows how the payload was encoded, regardless of how it is configured locally.
     if (Ar.IsLoading()) {
-        TArray<uint8> CompressedBuffer;
+        uint8 Codec = 0;
+        Ar << Codec;
         Ar << NumberOfBits;
-        Ar << CompressedBuffer;
-
-        FArchiveLoadCompressedProxy Decompressor(CompressedBuffer, NAME_Zlib, COMPRESS_BiasMemory);
-        Decompressor << SerializedBits;
 
         ++Sequence;
+
+        const bool bBaselineEncoded = (Codec & kBaselineEncodedFlag) != 0;
+        const uint8 ReceivedCompleteness = (Codec & kCompletenessMask) >> kCompletenessShift;
+        Codec &= kCodecMask;
+
+        if (ReceivedCompleteness >= EDataCompleteness::kCount) {
+            NumberOfBits = INDEX_NONE;
+            SerializedBits.Reset();
+
+            bOutSuccess = false;
+            return false;
+        }
+
+        PacketCompleteness = static_cast<EDataCompleteness>(ReceivedCompleteness);
+
+        FCompressedPayload& Received = bDeferDecode ? PendingPayload : GetCache().ReceivedScratch;
+        Received.Codec = static_cast<EBundleCodec>(Codec);
+        Received.bBaselineEncoded = bBaselineEncoded;
+        Received.RawSize = 0;
+
+        if (Received.Codec != EBundleCodec::kNone) {
+            Ar.SerializeIntPacked(Received.RawSize);
+        }
+
+        SerializeByteArray(Ar, Received.Bytes);
+
+        BaselineAck.Reset();
+        bDecodePending = false;
+
+        if (Codec >= static_cast<uint8>(EBundleCodec::kCount) || Ar.IsError()) {
+            NumberOfBits = INDEX_NONE;
+            SerializedBits.Reset();
+
+            bOutSuccess = false;
+            return false;
+        }
+
+        if (bDeferDecode) {
+            // Copies of the bundle share its baselines and the buffers used to decode, so they have to exist before the bundle is copied to be decoded.
+            if (bBaselineEncoded) { EnableBaselines(); }
+            GetCache();
+
+            SerializedBits.Reset();
+            bDecodePending = true;
+        }
+        else if (!DecodeReceived(Received)) {
+            bOutSuccess = false;
+            return false;
+        }
     }
     else {
-        TArray<uint8> CompressedBuffer;
-        FArchiveSaveCompressedProxy Compressor(CompressedBuffer, NAME_Zlib);
-        Compressor << SerializedBits;
-        Compressor.Flush();
-
+        const uint32 BaselineSequence = Baselines != nullptr ? Baselines->GetBaselineSequence(Map) : FBundleBaselines::kNoBaseline;
+
+        FCompressedPayload& Payload = FindCompressedPayload(BaselineSequence);
+        if (Payload.Sequence != Sequence || Payload.BaselineSequence != BaselineSequence) {
+            INC_DWORD_STAT(STAT_ClientPredictionCompressionCacheMisses);
+            EncodePayload(BaselineSequence, Payload);
+        }
+        else {
+            INC_DWORD_STAT(STAT_ClientPredictionCompressionCacheHits);
+        }
+
+        uint8 Codec = static_cast<uint8>(Payload.Codec) | (Payload.bBaselineEncoded ? kBaselineEncodedFlag : 0);
+        Codec |= (static_cast<uint8>(PacketCompleteness) << kCompletenessShift) & kCompletenessMask;
+        Ar << Codec;
         Ar << NumberOfBits;
-        Ar << CompressedBuffer;
+
+        if (Payload.Codec != EBundleCodec::kNone) {
+            Ar.SerializeIntPacked(Payload.RawSize);
+        }
+
+        SerializeByteArray(Ar, Payload.Bytes);
+    }
+
+    bOutSuccess = !Ar.IsError();
+    return true;
+}
+
+template <ClientPrediction::EDataCompleteness Completeness>
+bool FPacketBundle<Completeness>::DecodePayload() {
+    if (!bDecodePending) { return HasData(); }
+
+    bDecodePending = false;
+    return DecodeReceived(PendingPayload);
+}
+
+template <ClientPrediction::EDataCompleteness Completeness>
+bool FPacketBundle<Completeness>::DecodeReceived(FCompressedPayload& Received) {
+    using namespace ClientPrediction;
+
+    TArray<uint8>& Raw = Received.bBaselineEncoded ? GetCache().PayloadScratch : SerializedBits;
+    if (Received.Codec == EBundleCodec::kNone) {
+        // Swapping keeps both allocations around for the next bundle.
+        Swap(Raw, Received.Bytes);
+    }
+    else if (!FBundleCodec::Decode(Received.Codec, Received.Bytes, static_cast<int32>(Received.RawSize), Raw)) {
+        NumberOfBits = INDEX_NONE;
+        SerializedBits.Reset();
+        return false;
+    }
+
+    if (Received.bBaselineEncoded) {
+        EnableBaselines();
+
+        uint32 ReceivedSequence = FBundleBaselines::kNoBaseline;
+        bool bMissingBaseline = false;
+
+        if (!Baselines->Decode(Raw, SerializedBits, NumberOfBits, ReceivedSequence, bMissingBaseline)) {
+            NumberOfBits = INDEX_NONE;
+            SerializedBits.Reset();
+
+            // A baseline that is no longer known isn't an error, the authority just needs to send a keyframe instead.
+            if (!bMissingBaseline) { return false; }
+        }
+
+        BaselineAck = ReceivedSequence;
     }
 
-    bOutSuccess = true;
     return true;
 }
 
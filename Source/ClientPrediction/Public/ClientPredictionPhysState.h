@@ -5,6 +5,27 @@
 #include "ClientPredictionDataCompleteness.h"
 
 namespace ClientPrediction {
+    /**
+     * Shared by the states of a bundle. The first kLow state written to a bundle becomes the anchor, the positions of the states after it are written as
+     * small offsets from it. The anchor also carries the rotation bit width so that both sides agree on it, regardless of how they are configured.
+     * kMedium states share the quantization steps in the same way.
+     */
+    struct FPhysStateAnchor {
+        bool bIsSet = false;
+        int64 QuantizedX[3] = {};
+        int32 RotationBits = 0;
+
+        /** kMedium quantizes to powers of two derived from the tolerances of the sender. These are the exponents for position, velocity and angular velocity. */
+        bool bHasMediumSteps = false;
+        int32 MediumStepExponents[3] = {};
+        int32 MediumRotationBits = 0;
+
+        void Reset() {
+            bIsSet = false;
+            bHasMediumSteps = false;
+        }
+    };
+
     CLIENTPREDICTION_API struct FPhysState {
         /** These mirror the Chaos properties for a particle */
         Chaos::EObjectStateType ObjectState = Chaos::EObjectStateType::Uninitialized;
@@ -15,9 +36,47 @@ namespace ClientPrediction {
         Chaos::FRotation3 R = Chaos::FRotation3::Identity;
         Chaos::FVec3 W = Chaos::FVec3::ZeroVector;
 
+        /** The range of bits used for each of the three smallest quaternion components by kLow and kMedium. */
+        static constexpr int32 kMinRotationBits = 6;
+        static constexpr int32 kMaxRotationBits = 16;
+
         CLIENTPREDICTION_API bool ShouldReconcile(const FPhysState& State) const;
-        CLIENTPREDICTION_API void NetSerialize(FArchive& Ar, EDataCompleteness Completeness);
+
+        /**
+         * kMedium quantizes every value to a step below its cp.*Tolerance, so the error it introduces is never enough to cause a reconcile. Anchor is only
+         * used by kLow and kMedium. If it is null every state is written as its own anchor.
+         */
+        CLIENTPREDICTION_API void NetSerialize(FArchive& Ar, EDataCompleteness Completeness, FPhysStateAnchor* Anchor = nullptr);
+
+        /**
+         * An upper bound on the bits written by NetSerialize(). For kLow this is an anchor, which has the rotation bit width and three packed 64 bit
+         * positions, followed by the largest component index and three components of the widest supported rotation. kMedium is the object state, the
+         * steps, nine packed 64 bit values and the widest rotation.
+         */
+        static constexpr int32 GetMaxSerializedBits(EDataCompleteness Completeness) {
+            // The rotation bit width is written with SerializeInt(), which uses enough bits for every value up to kMaxRotationBits.
+            const int32 RotationBitsFieldBits = static_cast<int32>(FMath::CeilLogTwo(kMaxRotationBits + 1));
+
+            switch (Completeness) {
+            case EDataCompleteness::kLow:
+                return RotationBitsFieldBits + 3 * 80 + 2 + 3 * kMaxRotationBits;
+            case EDataCompleteness::kMedium:
+                return 8 + 3 * 6 + RotationBitsFieldBits + 9 * 80 + 2 + 3 * kMaxRotationBits;
+            default:
+                return 8 + 13 * 64;
+            }
+        }
+
+        /**
+         * Serializes the state with single precision relative to Origin and with the rotation stored as four 16 bit components. This is around 40% of the
+         * size of the full state and is precise enough for anything that is only used for interpolation.
+         */
+        CLIENTPREDICTION_API void SerializeCompact(FArchive& Ar, const Chaos::FVec3& Origin);
         CLIENTPREDICTION_API void Interpolate(const FPhysState& Other, Chaos::FReal Alpha);
         CLIENTPREDICTION_API void Extrapolate(const FPhysState& PrevState, Chaos::FReal StateDt, Chaos::FReal ExtrapolationTime);
+
+    private:
+        void SerializeLow(FArchive& Ar, FPhysStateAnchor& Anchor);
+        void SerializeMedium(FArchive& Ar, FPhysStateAnchor& Anchor);
     };
 }
@@ -0,0 +1,256 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+#include "ClientPredictionDataCompleteness.h"
+
+/**
+ * A declarative alternative to hand written serialization for states and inputs. A Traits type can declare a schema for its state and / or input:
+ *
+ *     struct FMyTraits {
+ *         using InputType = FMyInput;
+ *         using StateType = FMyState;
+ *
+ *         static constexpr auto StateSchema = ClientPrediction::MakeSchema(
+ *             ClientPrediction::QuantizedFloat(&FMyState::Fuel, 0.0f, 100.0f, 10),
+ *             ClientPrediction::RangedInt(&FMyState::Ammo, 0, 200, ClientPrediction::EDataCompleteness::kFull));
+ *
+ *         static constexpr auto InputSchema = ClientPrediction::MakeSchema(
+ *             ClientPrediction::QuantizedVector(&FMyInput::Throttle, -1.0f, 1.0f, 8),
+ *             ClientPrediction::Bool(&FMyInput::bJump));
+ *     };
+ *
+ * When a schema is present it is used to serialize, interpolate and reconcile the type instead of the hand written versions, which then don't need to
+ * exist. Each field declares the lowest completeness that includes it, so fields that are only needed for prediction can be left out of sim proxy bundles.
+ * Sim proxies get kLow and auto proxies kFull unless their cp.*Completeness CVars say otherwise (see EDataCompleteness). Lowering auto proxies to kMedium
+ * leaves kFull fields at their default values on the client, which will then be reconciled every time.
+ * Since every field has a fixed number of bits, the largest possible packet is known at compile time.
+ */
+namespace ClientPrediction {
+    namespace SchemaUtils {
+        /** The number of bits needed to store every value in [0, Range]. */
+        constexpr int32 BitsForRange(uint32 Range) {
+            int32 NumBits = 0;
+            for (; Range != 0; Range >>= 1) { ++NumBits; }
+            return NumBits;
+        }
+
+        constexpr uint32 MaxQuantized(int32 NumBits) { return NumBits >= 32 ? TNumericLimits<uint32>::Max() : (1u << NumBits) - 1; }
+
+        /** Not constexpr, so reaching it while a schema is evaluated at compile time is a compile error. Schemas built at runtime hit the check instead. */
+        inline void InvalidField(const TCHAR* Reason) { checkf(false, TEXT("Invalid schema field: %s"), Reason); }
+
+        constexpr void CheckField(bool bIsValid, const TCHAR* Reason) {
+            if (!bIsValid) { InvalidField(Reason); }
+        }
+
+        /** Quantized values are serialized through a uint32, so they can't take more than 32 bits. */
+        constexpr void CheckQuantizedField(double Min, double Max, int32 NumBits) {
+            CheckField(NumBits >= 1 && NumBits <= 32, TEXT("NumBits has to be between 1 and 32"));
+            CheckField(Max > Min, TEXT("Max has to be greater than Min"));
+        }
+
+        /** Inputs are bundled with kCount, which includes every field. */
+        constexpr bool IsIncluded(EDataCompleteness FieldCompleteness, EDataCompleteness Completeness) { return Completeness >= FieldCompleteness; }
+
+        template <typename ValueType>
+        void SerializeQuantized(ValueType& Value, ValueType Min, ValueType Max, int32 NumBits, FArchive& Ar) {
+            const uint32 MaxValue = MaxQuantized(NumBits);
+            uint32 Quantized = 0;
+
+            if (Ar.IsSaving()) {
+                const double Normalized = FMath::Clamp((static_cast<double>(Value) - Min) / (static_cast<double>(Max) - Min), 0.0, 1.0);
+                Quantized = static_cast<uint32>(FMath::RoundToDouble(Normalized * MaxValue));
+            }
+
+            Ar.SerializeBits(&Quantized, NumBits);
+
+            if (Ar.IsLoading()) {
+                Value = static_cast<ValueType>(Min + (static_cast<double>(Max) - Min) * (static_cast<double>(Quantized) / MaxValue));
+            }
+        }
+    }
+
+    /** A floating point member quantized to NumBits across [Min, Max]. Values outside of the range are clamped. */
+    template <typename OwnerType, typename ValueType>
+    struct TQuantizedFloatField {
+        ValueType OwnerType::* Member;
+        ValueType Min;
+        ValueType Max;
+        int32 NumBits;
+        EDataCompleteness Completeness;
+        ValueType Tolerance;
+
+        constexpr int32 GetMaxBits(EDataCompleteness InCompleteness) const { return SchemaUtils::IsIncluded(Completeness, InCompleteness) ? NumBits : 0; }
+
+        void NetSerialize(OwnerType& Owner, FArchive& Ar, EDataCompleteness InCompleteness) const {
+            if (!SchemaUtils::IsIncluded(Completeness, InCompleteness)) { return; }
+            SchemaUtils::SerializeQuantized(Owner.*Member, Min, Max, NumBits, Ar);
+        }
+
+        void Interpolate(OwnerType& Owner, const OwnerType& Other, Chaos::FReal Alpha) const {
+            Owner.*Member = FMath::Lerp(Owner.*Member, Other.*Member, static_cast<ValueType>(Alpha));
+        }
+
+        bool ShouldReconcile(const OwnerType& Owner, const OwnerType& Other) const { return FMath::Abs(Owner.*Member - Other.*Member) > Tolerance; }
+    };
+
+    /** A vector member with every component quantized to NumBits across [Min, Max]. */
+    template <typename OwnerType>
+    struct TQuantizedVectorField {
+        FVector OwnerType::* Member;
+        FVector::FReal Min;
+        FVector::FReal Max;
+        int32 NumBits;
+        EDataCompleteness Completeness;
+        FVector::FReal Tolerance;
+
+        constexpr int32 GetMaxBits(EDataCompleteness InCompleteness) const { return SchemaUtils::IsIncluded(Completeness, InCompleteness) ? NumBits * 3 : 0; }
+
+        void NetSerialize(OwnerType& Owner, FArchive& Ar, EDataCompleteness InCompleteness) const {
+            if (!SchemaUtils::IsIncluded(Completeness, InCompleteness)) { return; }
+
+            FVector& Value = Owner.*Member;
+            SchemaUtils::SerializeQuantized(Value.X, Min, Max, NumBits, Ar);
+            SchemaUtils::SerializeQuantized(Value.Y, Min, Max, NumBits, Ar);
+            SchemaUtils::SerializeQuantized(Value.Z, Min, Max, NumBits, Ar);
+        }
+
+        void Interpolate(OwnerType& Owner, const OwnerType& Other, Chaos::FReal Alpha) const {
+            Owner.*Member = FMath::Lerp(Owner.*Member, Other.*Member, Alpha);
+        }
+
+        bool ShouldReconcile(const OwnerType& Owner, const OwnerType& Other) const { return (Owner.*Member - Other.*Member).Size() > Tolerance; }
+    };
+
+    /** An integer member in [Min, Max], sent with just enough bits for the range. Integers are not blended, interpolation snaps to the newer value. */
+    template <typename OwnerType>
+    struct TRangedIntField {
+        int32 OwnerType::* Member;
+        int32 Min;
+        int32 Max;
+        EDataCompleteness Completeness;
+
+        constexpr int32 GetNumBits() const { return SchemaUtils::BitsForRange(static_cast<uint32>(static_cast<int64>(Max) - Min)); }
+        constexpr int32 GetMaxBits(EDataCompleteness InCompleteness) const { return SchemaUtils::IsIncluded(Completeness, InCompleteness) ? GetNumBits() : 0; }
+
+        void NetSerialize(OwnerType& Owner, FArchive& Ar, EDataCompleteness InCompleteness) const {
+            if (!SchemaUtils::IsIncluded(Completeness, InCompleteness)) { return; }
+
+            // The offset is computed in 64 bits since the range can be wider than an int32.
+            uint32 Offset = Ar.IsSaving() ? static_cast<uint32>(static_cast<int64>(FMath::Clamp(Owner.*Member, Min, Max)) - Min) : 0;
+            Ar.SerializeBits(&Offset, GetNumBits());
+
+            if (Ar.IsLoading()) {
+                Owner.*Member = static_cast<int32>(FMath::Min(static_cast<int64>(Min) + Offset, static_cast<int64>(Max)));
+            }
+        }
+
+        void Interpolate(OwnerType& Owner, const OwnerType& Other, Chaos::FReal Alpha) const { Owner.*Member = Other.*Member; }
+        bool ShouldReconcile(const OwnerType& Owner, const OwnerType& Other) const { return Owner.*Member != Other.*Member; }
+    };
+
+    template <typename OwnerType>
+    struct TBoolField {
+        bool OwnerType::* Member;
+        EDataCompleteness Completeness;
+
+        constexpr int32 GetMaxBits(EDataCompleteness InCompleteness) const { return SchemaUtils::IsIncluded(Completeness, InCompleteness) ? 1 : 0; }
+
+        void NetSerialize(OwnerType& Owner, FArchive& Ar, EDataCompleteness InCompleteness) const {
+            if (!SchemaUtils::IsIncluded(Completeness, InCompleteness)) { return; }
+
+            uint8 Value = Owner.*Member ? 1 : 0;
+            Ar.SerializeBits(&Value, 1);
+            Owner.*Member = Value != 0;
+        }
+
+        void Interpolate(OwnerType& Owner, const OwnerType& Other, Chaos::FReal Alpha) const { Owner.*Member = Other.*Member; }
+        bool ShouldReconcile(const OwnerType& Owner, const OwnerType& Other) const { return Owner.*Member != Other.*Member; }
+    };
+
+    /** An ordered list of fields. Fields are serialized in the order they are declared. */
+    template <typename... FieldTypes>
+    struct TSchema;
+
+    template <>
+    struct TSchema<> {
+        constexpr int32 GetMaxBits(EDataCompleteness Completeness) const { return 0; }
+
+        template <typename OwnerType>
+        void NetSerialize(OwnerType& Owner, FArchive& Ar, EDataCompleteness Completeness) const {}
+
+        template <typename OwnerType>
+        void Interpolate(OwnerType& Owner, const OwnerType& Other, Chaos::FReal Alpha) const {}
+
+        template <typename OwnerType>
+        bool ShouldReconcile(const OwnerType& Owner, const OwnerType& Other) const { return false; }
+    };
+
+    template <typename FieldType, typename... OtherFieldTypes>
+    struct TSchema<FieldType, OtherFieldTypes...> {
+        constexpr TSchema(FieldType InField, OtherFieldTypes... InOtherFields) : Field(InField), OtherFields(InOtherFields...) {}
+
+        constexpr int32 GetMaxBits(EDataCompleteness Completeness) const { return Field.GetMaxBits(Completeness) + OtherFields.GetMaxBits(Completeness); }
+
+        template <typename OwnerType>
+        void NetSerialize(OwnerType& Owner, FArchive& Ar, EDataCompleteness Completeness) const {
+            Field.NetSerialize(Owner, Ar, Completeness);
+            OtherFields.NetSerialize(Owner, Ar, Completeness);
+        }
+
+        template <typename OwnerType>
+        void Interpolate(OwnerType& Owner, const OwnerType& Other, Chaos::FReal Alpha) const {
+            Field.Interpolate(Owner, Other, Alpha);
+            OtherFields.Interpolate(Owner, Other, Alpha);
+        }
+
+        template <typename OwnerType>
+        bool ShouldReconcile(const OwnerType& Owner, const OwnerType& Other) const {
+            return Field.ShouldReconcile(Owner, Other) || OtherFields.ShouldReconcile(Owner, Other);
+        }
+
+        FieldType Field;
+        TSchema<OtherFieldTypes...> OtherFields;
+    };
+
+    template <typename... FieldTypes>
+    constexpr TSchema<FieldTypes...> MakeSchema(FieldTypes... Fields) { return TSchema<FieldTypes...>(Fields...); }
+
+    /**
+     * By default a field is reconciled once it is off by more than one quantization step. NumBits has to be between 1 and 32 and Max greater than Min,
+     * which fails to compile for schemas declared constexpr.
+     */
+    template <typename OwnerType, typename ValueType>
+    constexpr TQuantizedFloatField<OwnerType, ValueType> QuantizedFloat(ValueType OwnerType::* Member, ValueType Min, ValueType Max, int32 NumBits,
+                                                                        EDataCompleteness Completeness = EDataCompleteness::kLow, ValueType Tolerance = -1) {
+        SchemaUtils::CheckQuantizedField(Min, Max, NumBits);
+        const ValueType Step = (Max - Min) / static_cast<ValueType>(SchemaUtils::MaxQuantized(NumBits));
+        return {Member, Min, Max, NumBits, Completeness, Tolerance < 0 ? Step : Tolerance};
+    }
+
+    template <typename OwnerType>
+    constexpr TQuantizedVectorField<OwnerType> QuantizedVector(FVector OwnerType::* Member, FVector::FReal Min, FVector::FReal Max, int32 NumBits,
+                                                               EDataCompleteness Completeness = EDataCompleteness::kLow, FVector::FReal Tolerance = -1) {
+        SchemaUtils::CheckQuantizedField(Min, Max, NumBits);
+        const FVector::FReal Step = (Max - Min) / static_cast<FVector::FReal>(SchemaUtils::MaxQuantized(NumBits));
+        return {Member, Min, Max, NumBits, Completeness, Tolerance < 0 ? Step : Tolerance};
+    }
+
+    template <typename OwnerType>
+    constexpr TRangedIntField<OwnerType> RangedInt(int32 OwnerType::* Member, int32 Min, int32 Max, EDataCompleteness Completeness = EDataCompleteness::kLow) {
+        SchemaUtils::CheckField(Max > Min, TEXT("Max has to be greater than Min"));
+        return {Member, Min, Max, Completeness};
+    }
+
+    template <typename OwnerType>
+    constexpr TBoolField<OwnerType> Bool(bool OwnerType::* Member, EDataCompleteness Completeness = EDataCompleteness::kLow) {
+        return {Member, Completeness};
+    }
+
+    template <typename Traits>
+    concept CHasStateSchema = requires { Traits::StateSchema; };
+
+    template <typename Traits>
+    concept CHasInputSchema = requires { Traits::InputSchema; };
+}
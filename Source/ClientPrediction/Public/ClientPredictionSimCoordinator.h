@@ -3,6 +3,7 @@
 #include "CoreMinimal.h"
 #include "PBDRigidsSolver.h"
 #include "Physics/NetworkPhysicsComponent.h"
+#include "Tasks/Task.h"
 
 #include "ClientPredictionDelegate.h"
 #include "ClientPredictionSimInput.h"
@@ -20,6 +21,7 @@ namespace ClientPrediction {
         virtual void Destroy() = 0;
 
         virtual void ConsumeInputBundle(FBundledPackets Packets) = 0;
+        virtual void ConsumeInputAck(const FInputAck& Ack) = 0;
         virtual void ConsumeSimProxyStates(FBundledPacketsLow Packets) = 0;
         virtual void ConsumeAutoProxyStates(FBundledPacketsFull Packets) = 0;
         virtual void ConsumeFinalState(FBundledPacketsFull Packets) = 0;
@@ -29,6 +31,10 @@ namespace ClientPrediction {
 
         DECLARE_DELEGATE_OneParam(FRemoteSimProxyOffsetChangedDelegate, const FRemoteSimProxyOffset& Offset)
         FRemoteSimProxyOffsetChangedDelegate RemoteSimProxyOffsetChangedDelegate;
+
+        /** Called on the game thread with the baseline ack of every sim proxy bundle that was decoded off the game thread. */
+        DECLARE_DELEGATE_OneParam(FSimProxyStatesAckDelegate, uint32 Sequence)
+        FSimProxyStatesAckDelegate SimProxyStatesAckDelegate;
     };
 
     template <typename Traits>
@@ -66,6 +72,7 @@ namespace ClientPrediction {
         void OnPhysScenePostTick(FChaosScene* Scene);
 
         bool BuildTickInfo(FNetTickInfo& Info) const;
+        bool IsPartOfResim(const FNetTickInfo& TickInfo, Chaos::FPhysicsSolver* PhysSolver) const;
 
         FDelegateHandle InjectInputsGTDelegateHandle;
         FDelegateHandle PreAdvanceDelegateHandle;
@@ -79,6 +86,7 @@ namespace ClientPrediction {
 
     public:
         virtual void ConsumeInputBundle(FBundledPackets Packets) override;
+        virtual void ConsumeInputAck(const FInputAck& Ack) override;
         virtual void ConsumeSimProxyStates(FBundledPacketsLow Packets) override;
         virtual void ConsumeAutoProxyStates(FBundledPacketsFull Packets) override;
         virtual void ConsumeFinalState(FBundledPacketsFull Packets) override;
@@ -105,10 +113,17 @@ namespace ClientPrediction {
         Chaos::FReal CachedSolverTime = -1.0;
         int32 CachedTickNumber = INDEX_NONE;
         int32 EarliestLocalTick = INDEX_NONE;
+
+        /** Set in PreAdvance when the particle is not being resimulated this tick so that PostAdvance can skip the tick as well. */
+        bool bSkippingResimTick = false;
         Chaos::FReal LastResultsTime = -1.0;
 
         FCriticalSection FinalStateMutex;
         TOptional<FBundledPacketsFull> FinalStatePacket;
+        TAtomic<bool> bHasFinalStatePacket = false;
+
+        /** The latest sim proxy bundle being decoded off the game thread. Every bundle waits on the one before it since they share their baselines. */
+        UE::Tasks::FTask SimProxyDecodeTask;
     };
 
     template <typename Traits>
@@ -143,8 +158,8 @@ namespace ClientPrediction {
         AClientPredictionSimProxyManager* SimProxyWorldManager = AClientPredictionSimProxyManager::ManagerForWorld(GetWorld());
         if (SimProxyWorldManager == nullptr) { return; }
 
-        SimInput->SetBufferSize(RewindData->Capacity());
-        SimState->SetBufferSize(RewindData->Capacity());
+        SimInput->SetBufferSize(SimRole, RewindData->Capacity());
+        SimState->SetBufferSize(SimRole, RewindData->Capacity());
         SimEvents->SetHistoryDuration(RewindData->Capacity() * PhysSolver->GetAsyncDeltaTime());
 
         InjectInputsGTDelegateHandle = PhysCallback->InjectInputsExternal.AddRaw(this, &USimCoordinator::InjectInputsGT);
@@ -208,9 +223,24 @@ namespace ClientPrediction {
         const int32 RewindTick = SimState->GetRewindTick(PhysSolver, UpdatedComponent->GetPhysicsObjectByName(NAME_None));
         if (RewindTick != INDEX_NONE) {
             SimEvents->Rewind(RewindTick);
+            return RewindTick;
+        }
+
+        // Only the state diverged, so it is replayed right away without asking Chaos for a resim. The replay can still find that physics needs one.
+        const int32 StateReplayTick = SimState->GetStateReplayTick();
+        FNetTickInfo TickInfo{};
+        if (StateReplayTick != INDEX_NONE && BuildTickInfo(TickInfo)) {
+            SimEvents->Rewind(StateReplayTick);
+
+            const int32 ReplayRewindTick = SimState->ReplayState(TickInfo, PhysSolver, UpdatedComponent->GetPhysicsObjectByName(NAME_None),
+                                                                 [this](int32 ServerTick) { return SimInput->FindInput(ServerTick); });
+            if (ReplayRewindTick != INDEX_NONE) {
+                SimEvents->Rewind(ReplayRewindTick);
+                return ReplayRewindTick;
+            }
         }
 
-        return RewindTick;
+        return INDEX_NONE;
     }
 
     template <typename Traits>
@@ -237,12 +267,23 @@ namespace ClientPrediction {
         FNetTickInfo TickInfo{};
         if (!BuildTickInfo(TickInfo)) { return; }
 
-        if (SimRole != ROLE_Authority) {
-            FScopeLock FinalStateLock(&FinalStateMutex);
+        // The flag avoids taking the lock on every tick when there is no final state waiting.
+        if (SimRole != ROLE_Authority && bHasFinalStatePacket) {
+            FCountedScopeLock FinalStateLock(&FinalStateMutex);
             if (FinalStatePacket.IsSet()) {
                 SimState->ConsumeFinalState(FinalStatePacket.GetValue(), TickInfo);
                 FinalStatePacket.Reset();
             }
+
+            bHasFinalStatePacket = false;
+        }
+
+        // With cp.PartialIslandResim the solver only replays the islands that were marked for it. Other sims would produce exactly the same states again,
+        // so they are skipped entirely.
+        bSkippingResimTick = !IsPartOfResim(TickInfo, PhysSolver);
+        if (bSkippingResimTick) {
+            INC_DWORD_STAT(STAT_ClientPredictionResimTicksSkipped);
+            return;
         }
 
         // State needs to come before the input because the input depends on the current state. If the simulation is over we don't need to prepare input anymore.
@@ -270,6 +311,8 @@ namespace ClientPrediction {
             return;
         }
 
+        if (bSkippingResimTick) { return; }
+
         FNetTickInfo TickInfo{};
         if (!BuildTickInfo(TickInfo)) { return; }
 
@@ -295,7 +338,14 @@ namespace ClientPrediction {
             SimInput->EmitInputs();
         }
 
+        if (SimRole == ENetRole::ROLE_SimulatedProxy) {
+            while (TOptional<uint32> Ack = SimState->DequeueSimProxyStatesAck()) {
+                SimProxyStatesAckDelegate.ExecuteIfBound(Ack.GetValue());
+            }
+        }
+
         if (SimRole == ENetRole::ROLE_Authority) {
+            SimInput->EmitInputAck();
             SimState->EmitStates();
             SimEvents->EmitEvents();
         }
@@ -333,6 +383,20 @@ namespace ClientPrediction {
         return true;
     }
 
+    template <typename Traits>
+    bool USimCoordinator<Traits>::IsPartOfResim(const FNetTickInfo& TickInfo, Chaos::FPhysicsSolver* PhysSolver) const {
+        if (!TickInfo.bIsResim || !ClientPredictionPartialIslandResim) { return true; }
+
+        Chaos::FReadPhysicsObjectInterface_Internal Interface = Chaos::FPhysicsObjectInternalInterface::GetRead();
+        Chaos::FPBDRigidParticleHandle* ParticleHandle = Interface.GetRigidParticle(UpdatedComponent->GetPhysicsObjectByName(NAME_None));
+        if (ParticleHandle == nullptr) { return true; }
+
+        // Particles are only resimulated from the frame their island was marked with, everything before that is just replayed from the rewind data.
+        // Particles that aren't in any marked island have no resim frame, which only means they are left out if the solver resimulates partial islands.
+        const int32 ParticleResimFrame = PhysSolver->GetEvolution()->GetIslandManager().GetParticleResimFrame(ParticleHandle);
+        return ParticleResimFrame != INDEX_NONE && TickInfo.LocalTick >= ParticleResimFrame;
+    }
+
     template <typename Traits>
     void USimCoordinator<Traits>::ConsumeInputBundle(FBundledPackets Packets) {
         if (UpdatedComponent == nullptr || SimInput == nullptr) { return; }
@@ -345,10 +409,32 @@ namespace ClientPrediction {
         });
     }
 
+    template <typename Traits>
+    void USimCoordinator<Traits>::ConsumeInputAck(const FInputAck& Ack) {
+        // Inputs are sent from the game thread, so the ack doesn't need to go through the physics thread.
+        if (SimInput == nullptr || SimRole != ROLE_AutonomousProxy) { return; }
+        SimInput->ConsumeInputAck(Ack);
+    }
+
     template <typename Traits>
     void USimCoordinator<Traits>::ConsumeSimProxyStates(FBundledPacketsLow Packets) {
         if (UpdatedComponent == nullptr || SimState == nullptr || SimRole != ROLE_SimulatedProxy) { return; }
 
+        if (Packets.Bundle().IsDecodePending()) {
+            Chaos::FPhysicsSolver* PhysSolver = GetPhysSolver();
+            if (PhysSolver == nullptr) { return; }
+
+            // The task holds on to the sim state, so it doesn't matter if the sim is destroyed before it finishes.
+            auto Decode = [SimState = SimState, Packets = MoveTemp(Packets), SimDt = PhysSolver->GetAsyncDeltaTime()]() {
+                SimState->DecodeSimProxyStates(Packets, SimDt);
+            };
+
+            SimProxyDecodeTask = SimProxyDecodeTask.IsValid()
+                                     ? UE::Tasks::Launch(UE_SOURCE_LOCATION, MoveTemp(Decode), UE::Tasks::Prerequisites(SimProxyDecodeTask))
+                                     : UE::Tasks::Launch(UE_SOURCE_LOCATION, MoveTemp(Decode));
+            return;
+        }
+
         FPhysScene* PhysScene = GetPhysScene();
         if (PhysScene == nullptr) { return; }
 
@@ -373,8 +459,9 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimCoordinator<Traits>::ConsumeFinalState(FBundledPacketsFull Packets) {
-        FScopeLock FinalStateLock(&FinalStateMutex);
+        FCountedScopeLock FinalStateLock(&FinalStateMutex);
         FinalStatePacket = MoveTemp(Packets);
+        bHasFinalStatePacket = true;
     }
 
     template <typename Traits>
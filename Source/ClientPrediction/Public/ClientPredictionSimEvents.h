@@ -1,32 +1,62 @@
 ﻿#pragma once
 
 #include "CoreMinimal.h"
+#include "Containers/RingBuffer.h"
 #include "ClientPredictionNetSerialization.h"
 #include "ClientPredictionSimProxy.h"
+#include "ClientPredictionStats.h"
 #include "ClientPredictionTick.h"
 
 // For now events are ONLY predicted on auto proxies and replicated on sim proxies. In the future we might need to change this
 // so that the server can inform an auto proxy has executed event it mispredicted. It might also make sense to be able to rewind events as well.
 
 namespace ClientPrediction {
+    /** The index an event type was registered at in its sim. This is what is sent over the network, so it only depends on the registration order. */
     using EventId = uint8;
 
-    struct FEventIds {
-        static EventId kNextEventId;
-
+    /**
+     * Numbers event types in the order they are first used in this process so that a sim can find the factory for a type with a single indexed load.
+     * These numbers depend on what else the process has run, so they are never sent over the network.
+     */
+    struct CLIENTPREDICTION_API FEventTypeIndex {
         template <typename EventType>
-        static EventId GetId() {
-            static EventId kEventId = ++kNextEventId;
-            return kEventId;
+        static int32 Get() {
+            static const int32 kTypeIndex = Allocate();
+            return kTypeIndex;
         }
+
+    private:
+        static int32 Allocate();
     };
 
-    EventId FEventIds::kNextEventId = 0;
+    /** How an event type is sent to sim proxies. An event type can declare static constexpr EEventDelivery kDelivery to choose, it is reliable otherwise. */
+    enum class EEventDelivery : uint8 {
+        kReliable,
+
+        /** Sent unreliably in up to cp.EventRedundancy batches until the client acknowledges it. Meant for cosmetic events that can be lost. */
+        kUnreliable
+    };
 
     struct FEventWrapperBase {
         virtual ~FEventWrapperBase() = default;
         EventId EventId = INDEX_NONE;
+        EEventDelivery Delivery = EEventDelivery::kReliable;
+
+        int32 LocalTick = INDEX_NONE;
+        int32 ServerTick = INDEX_NONE;
+
+        Chaos::FReal ExecutionTime = 0.0;
+        Chaos::FReal TimeSincePredicted = 0.0;
 
+        /** Hash of the event payload, or 0 if the event type doesn't provide GetTypeHash. Used to look up duplicates of predicted events. */
+        uint32 PayloadHash = 0;
+
+        bool bHasExecuted = false;
+
+        /** Set when a rewind removes the event before it executed. It is never executed and is dropped along with the rest of the history. */
+        bool bIsCancelled = false;
+
+        virtual void Execute() = 0;
         virtual void NetSerialize(FArchive& Ar) = 0;
     };
 
@@ -49,24 +79,16 @@ namespace ClientPrediction {
         TMulticastDelegate<void(const EventType&, Chaos::FReal)>* Delegate = nullptr;
         EventType Event{};
 
-        int32 LocalTick = INDEX_NONE;
-        int32 ServerTick = INDEX_NONE;
-
-        Chaos::FReal ExecutionTime = 0.0;
-        Chaos::FReal TimeSincePredicted = 0.0;
-
-        bool bHasExecuted = false;
-
-        void Execute();
+        virtual void Execute() override;
         virtual void NetSerialize(FArchive& Ar) override;
     };
 
     template <typename EventType>
     void FEventWrapper<EventType>::Execute() {
-        if (Delegate == nullptr) { return; }
+        bHasExecuted = true;
 
+        if (Delegate == nullptr) { return; }
         Delegate->Broadcast(Event, TimeSincePredicted);
-        bHasExecuted = true;
     }
 
     template <typename EventType>
@@ -77,14 +99,89 @@ namespace ClientPrediction {
         Event.NetSerialize(Ar);
     }
 
+    /**
+     * Every event of a sim in the order it will execute. Events that haven't executed yet are kept in a min-heap on their execution time, so a frame only
+     * looks at the events that are due. All events are also kept in the order they were created until they fall out of the history, which lets the
+     * history be trimmed from the front. Predicted events are additionally indexed by their local tick and payload hash so that resims can find
+     * duplicates without scanning the history.
+     */
+    class CLIENTPREDICTION_API FEventQueue {
+    public:
+        void Add(TUniquePtr<FEventWrapperBase> Event);
+
+        void ExecuteDue(Chaos::FReal Time);
+        void Prune(Chaos::FReal HistoryStartTime);
+        void Rewind(int32 LocalRewindTick);
+
+        /**
+         * Returns true if IsIdentical is true for any predicted event in the history with the same id, local tick and payload hash. Only those events
+         * are looked at, so types that don't provide a hash are compared against every event of their type on that tick.
+         */
+        template <typename PredicateType>
+        bool ContainsEvent(EventId EventId, int32 LocalTick, uint32 PayloadHash, PredicateType&& IsIdentical) const;
+
+        /** Calls Visit for every event that was added since the last call. */
+        template <typename VisitorType>
+        void ForEachUnemitted(VisitorType&& Visit);
+
+    private:
+        struct FEventKey {
+            EventId EventId = 0;
+            int32 LocalTick = INDEX_NONE;
+            uint32 PayloadHash = 0;
+
+            bool operator==(const FEventKey& Other) const {
+                return EventId == Other.EventId && LocalTick == Other.LocalTick && PayloadHash == Other.PayloadHash;
+            }
+
+            friend uint32 GetTypeHash(const FEventKey& Key) {
+                return HashCombineFast(HashCombineFast(::GetTypeHash(Key.EventId), ::GetTypeHash(Key.LocalTick)), Key.PayloadHash);
+            }
+        };
+
+        static FEventKey MakeKey(const FEventWrapperBase& Event) { return {Event.EventId, Event.LocalTick, Event.PayloadHash}; }
+
+        struct FPendingEvent {
+            Chaos::FReal ExecutionTime = 0.0;
+            uint64 Order = 0;
+            FEventWrapperBase* Event = nullptr;
+
+            /** Orders the heap by execution time, events for the same time execute in the order they were added. */
+            bool operator<(const FPendingEvent& Other) const {
+                return ExecutionTime < Other.ExecutionTime || (ExecutionTime == Other.ExecutionTime && Order < Other.Order);
+            }
+        };
+
+        TRingBuffer<TUniquePtr<FEventWrapperBase>> Events;
+        TArray<FPendingEvent> Pending;
+        TMultiMap<FEventKey, FEventWrapperBase*> PredictedEvents;
+
+        uint64 NextOrder = 0;
+        int32 NumUnemitted = 0;
+    };
+
+    template <typename PredicateType>
+    bool FEventQueue::ContainsEvent(EventId EventId, int32 LocalTick, uint32 PayloadHash, PredicateType&& IsIdentical) const {
+        for (auto It = PredictedEvents.CreateConstKeyIterator(FEventKey{EventId, LocalTick, PayloadHash}); It; ++It) {
+            if (IsIdentical(*It.Value())) { return true; }
+        }
+
+        return false;
+    }
+
+    template <typename VisitorType>
+    void FEventQueue::ForEachUnemitted(VisitorType&& Visit) {
+        for (int32 EventIdx = Events.Num() - NumUnemitted; EventIdx < Events.Num(); ++EventIdx) {
+            Visit(*Events[EventIdx]);
+        }
+
+        NumUnemitted = 0;
+    }
+
     struct FEventFactoryBase {
         virtual ~FEventFactoryBase() = default;
-        virtual void CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data) = 0;
-        virtual void CreateEvent(FArchive& Ar, Chaos::FReal SimDt) = 0;
-
-        virtual void ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole, Chaos::FReal HistoryDuration) = 0;
-        virtual void Rewind(int32 LocalRewindTick) = 0;
-        virtual int32 EmitEvents(int32 LatestEmittedTick, TArray<FEventSaver>& Serializers) = 0;
+        virtual void CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data, FEventQueue& Queue) = 0;
+        virtual void CreateEvent(FArchive& Ar, Chaos::FReal SimDt, FEventQueue& Queue) = 0;
     };
 
     template <typename EventType>
@@ -92,109 +189,84 @@ namespace ClientPrediction {
         using WrappedEvent = FEventWrapper<EventType>;
 
         FEventFactory(int32 EventId) : EventId(EventId) {}
-        virtual void CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data) override;
-        virtual void CreateEvent(FArchive& Ar, Chaos::FReal SimDt) override;
+        virtual void CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data, FEventQueue& Queue) override;
+        virtual void CreateEvent(FArchive& Ar, Chaos::FReal SimDt, FEventQueue& Queue) override;
 
-        virtual void ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole, Chaos::FReal HistoryDuration) override;
-        virtual void Rewind(int32 LocalRewindTick) override;
-        virtual int32 EmitEvents(int32 LatestEmittedTick, TArray<FEventSaver>& Serializers) override;
+        /** Has to agree with EventType::NetIdentical(), see USimEvents::RegisterEvent(). */
+        static uint32 HashEvent(const EventType& EventData);
+        static constexpr EEventDelivery GetDelivery();
 
         TMulticastDelegate<void(const EventType&, Chaos::FReal)> Delegate;
         int32 EventId = INDEX_NONE;
-
-        TArray<WrappedEvent> Events;
     };
 
     template <typename EventType>
-    void FEventFactory<EventType>::CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data) {
+    void FEventFactory<EventType>::CreateEvent(const FNetTickInfo& TickInfo, int32 RemoteSimProxyOffset, const void* Data, FEventQueue& Queue) {
         // We check for duplicate events that have already been emitted so that during resims we don't get a bunch of duplicate
         // events all firing off.
         const EventType& EventData = *static_cast<const EventType*>(Data);
-        for (WrappedEvent& Event : Events) {
-            if (!Event.bHasExecuted || TickInfo.LocalTick != Event.LocalTick) { continue; }
-            if (Event.Event.NetIdentical(EventData)) {
-                return;
-            }
-        }
+        const uint32 PayloadHash = HashEvent(EventData);
 
-        WrappedEvent NewEvent{};
-        NewEvent.EventId = EventId;
-        NewEvent.LocalTick = TickInfo.LocalTick;
-        NewEvent.ServerTick = TickInfo.ServerTick;
+        const bool bIsDuplicate = Queue.ContainsEvent(EventId, TickInfo.LocalTick, PayloadHash, [&](const FEventWrapperBase& Event) {
+            // The hash only narrows down the candidates, NetIdentical still decides so that a collision can't swallow an event.
+            return Event.bHasExecuted && static_cast<const WrappedEvent&>(Event).Event.NetIdentical(EventData);
+        });
 
-        NewEvent.ExecutionTime = TickInfo.StartTime;
-        NewEvent.TimeSincePredicted = FMath::Abs(static_cast<Chaos::FReal>(FMath::Min(RemoteSimProxyOffset, 0)) * TickInfo.Dt);
+        if (bIsDuplicate) { return; }
 
-        NewEvent.Delegate = &Delegate;
-        NewEvent.Event = EventData;
+        TUniquePtr<WrappedEvent> NewEvent = MakeUnique<WrappedEvent>();
+        NewEvent->EventId = EventId;
+        NewEvent->LocalTick = TickInfo.LocalTick;
+        NewEvent->ServerTick = TickInfo.ServerTick;
+        NewEvent->PayloadHash = PayloadHash;
+        NewEvent->Delivery = GetDelivery();
 
-        Events.Emplace(MoveTemp(NewEvent));
-    }
+        NewEvent->ExecutionTime = TickInfo.StartTime;
+        NewEvent->TimeSincePredicted = FMath::Abs(static_cast<Chaos::FReal>(FMath::Min(RemoteSimProxyOffset, 0)) * TickInfo.Dt);
 
-    template <typename EventType>
-    void FEventFactory<EventType>::CreateEvent(FArchive& Ar, Chaos::FReal SimDt) {
-        WrappedEvent NewEvent{};
-        NewEvent.EventId = EventId;
-        NewEvent.Delegate = &Delegate;
+        NewEvent->Delegate = &Delegate;
+        NewEvent->Event = EventData;
 
-        NewEvent.NetSerialize(Ar);
-        NewEvent.ExecutionTime = static_cast<Chaos::FReal>(NewEvent.ServerTick) * SimDt;
-
-        // We don't need to check for duplicate events here because the authority sends them reliably.
-        Events.Emplace(MoveTemp(NewEvent));
+        Queue.Add(MoveTemp(NewEvent));
     }
 
     template <typename EventType>
-    void FEventFactory<EventType>::ExecuteEvents(Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, ENetRole SimRole, Chaos::FReal HistoryDuration) {
-        const Chaos::FReal AdjustedResultsTime = SimRole != ROLE_SimulatedProxy ? ResultsTime : ResultsTime + SimProxyOffset;
-        const Chaos::FReal HistoryStartTime = AdjustedResultsTime - HistoryDuration;
-
-        for (WrappedEvent& Event : Events) {
-            if (AdjustedResultsTime < Event.ExecutionTime || Event.bHasExecuted) {
-                continue;
-            }
-
-            Event.Execute();
+    uint32 FEventFactory<EventType>::HashEvent(const EventType& EventData) {
+        if constexpr (requires { GetTypeHash(EventData); }) {
+            return GetTypeHash(EventData);
         }
-
-        for (int32 EventIdx = 0; EventIdx < Events.Num();) {
-            if (Events[EventIdx].ExecutionTime < HistoryStartTime && Events[EventIdx].bHasExecuted) {
-                Events.RemoveAt(EventIdx);
-                continue;
-            }
-
-            ++EventIdx;
+        else {
+            return 0;
         }
     }
 
     template <typename EventType>
-    void FEventFactory<EventType>::Rewind(int32 LocalRewindTick) {
-        for (int32 EventIdx = 0; EventIdx < Events.Num();) {
-            if (Events[EventIdx].LocalTick >= LocalRewindTick && !Events[EventIdx].bHasExecuted) {
-                Events.RemoveAt(EventIdx);
-                continue;
-            }
-
-            ++EventIdx;
+    constexpr EEventDelivery FEventFactory<EventType>::GetDelivery() {
+        if constexpr (requires { EventType::kDelivery; }) {
+            return EventType::kDelivery;
+        }
+        else {
+            return EEventDelivery::kReliable;
         }
     }
 
     template <typename EventType>
-    int32 FEventFactory<EventType>::EmitEvents(int32 LatestEmittedTick, TArray<FEventSaver>& Serializers) {
-        int32 NewestEvent = INDEX_NONE;
+    void FEventFactory<EventType>::CreateEvent(FArchive& Ar, Chaos::FReal SimDt, FEventQueue& Queue) {
+        TUniquePtr<WrappedEvent> NewEvent = MakeUnique<WrappedEvent>();
+        NewEvent->EventId = EventId;
+        NewEvent->Delivery = GetDelivery();
+        NewEvent->Delegate = &Delegate;
 
-        for (WrappedEvent& Event : Events) {
-            if (Event.ServerTick > LatestEmittedTick) {
-                NewestEvent = FMath::Max(Event.ServerTick, NewestEvent);
-                Serializers.Add(FEventSaver(Event));
-            }
-        }
+        NewEvent->NetSerialize(Ar);
+        NewEvent->ExecutionTime = static_cast<Chaos::FReal>(NewEvent->ServerTick) * SimDt;
 
-        return NewestEvent;
+        // We don't need to check for duplicate events here because each bundle is only consumed once, even unreliable ones that are sent more than once.
+        Queue.Add(MoveTemp(NewEvent));
     }
 
     struct FEventLoaderUserdata {
-        const TMap<EventId, TUniquePtr<FEventFactoryBase>>& Factories;
+        const TArray<TUniquePtr<FEventFactoryBase>>& Factories;
+        FEventQueue& Queue;
         Chaos::FReal SimDt;
     };
 
@@ -208,14 +280,26 @@ namespace ClientPrediction {
         EventId EventId;
         Ar << EventId;
 
-        check(Userdata.Factories.Contains(EventId));
-        Userdata.Factories[EventId]->CreateEvent(Ar, Userdata.SimDt);
+        // An unknown id means the bundle is malformed or the sender registered different events. The rest of the bundle can't be read either way.
+        if (Ar.IsError() || !Userdata.Factories.IsValidIndex(EventId)) {
+            Ar.SetError();
+            return;
+        }
+
+        Userdata.Factories[EventId]->CreateEvent(Ar, Userdata.SimDt, Userdata.Queue);
     }
 
     class CLIENTPREDICTION_API USimEvents {
     public:
+        static constexpr int32 kMaxEventTypes = TNumericLimits<EventId>::Max() + 1;
+
         void SetHistoryDuration(Chaos::FReal NewHistoryDuration) { HistoryDuration = NewHistoryDuration; }
 
+        /**
+         * Events dispatched again during a resim are dropped if an identical event already executed on the same tick. If EventType has a GetTypeHash(), it
+         * is used to find those events and must agree with NetIdentical(): two events that are NetIdentical() must have the same hash, otherwise the
+         * duplicate isn't found and the event executes twice. Types without a GetTypeHash() are compared against every event of their type on the tick.
+         */
         template <typename EventType>
         TMulticastDelegate<void(const EventType&, Chaos::FReal)>& RegisterEvent();
 
@@ -231,11 +315,19 @@ namespace ClientPrediction {
 
         void EmitEvents();
 
-        DECLARE_DELEGATE_OneParam(FEmitEventBundleDelegate, const FBundledPackets& Bundle)
+        DECLARE_DELEGATE_TwoParams(FEmitEventBundleDelegate, const FBundledPackets& Bundle, EEventDelivery Delivery)
         FEmitEventBundleDelegate EmitEventBundle;
 
     private:
-        TMap<EventId, TUniquePtr<FEventFactoryBase>> Factories;
+        void EmitBundles(TArray<FEventSaver>& Serializers, EEventDelivery Delivery);
+
+        /** Indexed by EventId. */
+        TArray<TUniquePtr<FEventFactoryBase>> Factories;
+
+        /** Indexed by FEventTypeIndex, null for types that weren't registered with this sim. */
+        TArray<FEventFactoryBase*> FactoriesByType;
+
+        FEventQueue Queue;
 
         FCriticalSection EventMutex;
         int32 HistoryDuration = INDEX_NONE;
@@ -248,22 +340,32 @@ namespace ClientPrediction {
 
     template <typename EventType>
     TMulticastDelegate<void(const EventType&, Chaos::FReal)>& USimEvents::RegisterEvent() {
-        const EventId EventId = FEventIds::GetId<EventType>();
-        TUniquePtr<FEventFactory<EventType>> Handler = MakeUnique<FEventFactory<EventType>>(EventId);
+        const int32 TypeIndex = FEventTypeIndex::Get<EventType>();
+        if (FactoriesByType.IsValidIndex(TypeIndex) && FactoriesByType[TypeIndex] != nullptr) {
+            return static_cast<FEventFactory<EventType>*>(FactoriesByType[TypeIndex])->Delegate;
+        }
+
+        checkf(Factories.Num() < kMaxEventTypes, TEXT("A sim can't register more than %d event types."), kMaxEventTypes);
+        TUniquePtr<FEventFactory<EventType>> Handler = MakeUnique<FEventFactory<EventType>>(Factories.Num());
+
+        if (!FactoriesByType.IsValidIndex(TypeIndex)) {
+            FactoriesByType.SetNumZeroed(TypeIndex + 1);
+        }
+        FactoriesByType[TypeIndex] = Handler.Get();
 
         TMulticastDelegate<void(const EventType&, Chaos::FReal)>& Delegate = Handler->Delegate;
-        Factories.Add(EventId, MoveTemp(Handler));
+        Factories.Add(MoveTemp(Handler));
 
         return Delegate;
     }
 
     template <typename EventType>
     void USimEvents::DispatchEvent(const FNetTickInfo& TickInfo, const EventType& NewEvent) {
-        FScopeLock EventLock(&EventMutex);
+        FCountedScopeLock EventLock(&EventMutex);
 
-        const EventId EventId = FEventIds::GetId<EventType>();
-        if (!Factories.Contains(EventId)) { return; }
+        const int32 TypeIndex = FEventTypeIndex::Get<EventType>();
+        if (!FactoriesByType.IsValidIndex(TypeIndex) || FactoriesByType[TypeIndex] == nullptr) { return; }
 
-        Factories[EventId]->CreateEvent(TickInfo, RemoteSimProxyOffset, &NewEvent);
+        FactoriesByType[TypeIndex]->CreateEvent(TickInfo, RemoteSimProxyOffset, &NewEvent, Queue);
     }
 }
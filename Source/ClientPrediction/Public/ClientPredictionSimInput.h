@@ -1,8 +1,12 @@
 ﻿#pragma once
 
+#include "Misc/ScopeExit.h"
+
 #include "ClientPredictionCVars.h"
 #include "ClientPredictionDelegate.h"
+#include "ClientPredictionInputWindow.h"
 #include "ClientPredictionNetSerialization.h"
+#include "ClientPredictionSchema.h"
 #include "ClientPredictionTick.h"
 
 namespace ClientPrediction {
@@ -12,16 +16,35 @@ namespace ClientPrediction {
 
         DECLARE_DELEGATE_OneParam(FEmitInputBundleDelegate, const FBundledPackets& Bundle)
         FEmitInputBundleDelegate EmitInputBundleDelegate;
+
+        DECLARE_DELEGATE_OneParam(FEmitInputAckDelegate, const FInputAck& Ack)
+        FEmitInputAckDelegate EmitInputAckDelegate;
     };
 
-    template <typename InputType>
+    template <typename Traits>
     struct FWrappedInput {
+        using InputType = typename Traits::InputType;
+
         int32 ServerTick = INDEX_NONE;
         InputType Input;
 
-        void NetSerialize(FArchive& Ar, void* Userdata) {
-            Ar << ServerTick;
-            Input.NetSerialize(Ar);
+        /** The tick isn't serialized, the input window sends the ticks for a whole run of inputs at once. */
+        void SerializeInput(FArchive& Ar) {
+            if constexpr (CHasInputSchema<Traits>) {
+                Traits::InputSchema.NetSerialize(Input, Ar, EDataCompleteness::kCount);
+            }
+            else {
+                Input.NetSerialize(Ar);
+            }
+        }
+
+        static constexpr int64 GetMaxInputBits() {
+            if constexpr (CHasInputSchema<Traits>) {
+                return Traits::InputSchema.GetMaxBits(EDataCompleteness::kCount);
+            }
+            else {
+                return TNumericLimits<uint16>::Max();
+            }
         }
     };
 
@@ -30,12 +53,12 @@ namespace ClientPrediction {
     private:
         using InputType = typename Traits::InputType;
         using StateType = typename Traits::StateType;
-        using WrappedInput = FWrappedInput<InputType>;
+        using WrappedInput = FWrappedInput<Traits>;
 
     public:
         virtual ~USimInput() override = default;
         void SetSimDelegates(const TSharedPtr<FSimDelegates<Traits>>& NewSimDelegates);
-        void SetBufferSize(int32 BufferSize);
+        void SetBufferSize(ENetRole SimRole, int32 RewindCapacity);
 
     private:
         TSharedPtr<FSimDelegates<Traits>> SimDelegates;
@@ -44,13 +67,21 @@ namespace ClientPrediction {
 
     public:
         void ConsumeInputBundle(const FBundledPackets& Packets);
+        void ConsumeInputAck(const FInputAck& Ack);
 
         void InjectInputsGT();
         void PreparePrePhysics(const FNetTickInfo& TickInfo, const StateType& PrevState);
         void EmitInputs();
+        void EmitInputAck();
+
+        /** Returns the input that was used for ServerTick, or nullptr if it is no longer buffered. */
+        const InputType* FindInput(int32 ServerTick) const;
 
     private:
         bool ShouldProduceInput(const FNetTickInfo& TickInfo);
+        int32 FindBestInputIndex(int32 ServerTick) const;
+        static void EncodeInput(WrappedInput& Input, FEncodedInput& OutEncoded);
+        void UpdateAck(int32 FirstReceivedTick);
 
     private:
         TArray<WrappedInput> Inputs;
@@ -58,7 +89,28 @@ namespace ClientPrediction {
 
         FCriticalSection SendMutex;
         TArray<WrappedInput> PendingSend; // Inputs that need to be sent at least once
-        TArray<WrappedInput> SendWindow; // Inputs that were previously sent (behaves like a sliding window)
+        TArray<FEncodedInput> SendWindow; // Inputs that were previously sent (behaves like a sliding window)
+
+        // Reused so that sending and receiving inputs doesn't allocate in steady state
+        FBundledPackets SendPackets;
+        TArray<FInputRun> SendRuns;
+        FInputWindowContext SendContext;
+
+        TArray<FInputRun> ReceivedRuns;
+        FInputWindowContext ReceiveContext;
+
+        // Sending only keeps inputs that the authority hasn't acknowledged yet. Each one is sent at least until its ack could have arrived, which is the
+        // number of sends it took for the latest acked input to be acknowledged, and at least as many times as the reported loss calls for.
+        FInputAck LatestAck{};
+        int32 AckRoundTripSends = INDEX_NONE;
+        TArray<FEncodedInput> FreeEncodedInputs;
+
+        // Authority only. The ack is built on the physics thread and emitted on the game thread.
+        FInputLossEstimator LossEstimator;
+        int32 LastSimulatedTick = INDEX_NONE;
+
+        FCriticalSection AckMutex;
+        FInputAck PendingAck{};
 
     public:
         const InputType& GetCurrentInput() { return CurrentInput.Input; }
@@ -77,7 +129,9 @@ namespace ClientPrediction {
     }
 
     template <typename Traits>
-    void USimInput<Traits>::SetBufferSize(int32 BufferSize) {
+    void USimInput<Traits>::SetBufferSize(ENetRole SimRole, int32 RewindCapacity) {
+        // Sim proxies never produce or consume inputs, but the buffer still needs a slot so that indexing into it is valid.
+        const int32 BufferSize = SimRole == ROLE_SimulatedProxy ? 1 : RewindCapacity;
         while (Inputs.Num() < BufferSize) {
             Inputs.AddDefaulted();
             Inputs.Last().ServerTick = TNumericLimits<int32>::Min();
@@ -92,17 +146,65 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimInput<Traits>::ConsumeInputBundle(const FBundledPackets& Packets) {
-        TArray<WrappedInput> BundleInputs;
-        Packets.Bundle().Retrieve<>(BundleInputs, this);
+        ReceivedRuns.Reset();
+        if (!Packets.Bundle().Retrieve(ReceivedRuns, &ReceiveContext) || ReceivedRuns.IsEmpty()) { return; }
+
+        LossEstimator.ReceiveSequence(ReceiveContext.Sequence);
+        ON_SCOPE_EXIT { UpdateAck(ReceivedRuns[0].FirstTick); };
+
+        for (const FInputRun& Run : ReceivedRuns) {
+            // Every tick of a run has the same input, so it is only deserialized once and only if one of the ticks is actually needed.
+            WrappedInput NewInput{};
+            bool bDeserialized = false;
+
+            for (int32 Tick = Run.FirstTick; Tick < Run.FirstTick + Run.NumTicks; ++Tick) {
+                WrappedInput& BufferedInput = Inputs[BufferIndex(Tick)];
+                if (BufferedInput.ServerTick >= Tick) { continue; }
+
+                if (!bDeserialized) {
+                    FNetBitReader& Reader = FScratchArchives::GetReader(ReceiveContext.GetBytes(Run), Run.NumBits);
+                    NewInput.SerializeInput(Reader);
+
+                    if (Reader.IsError()) { return; }
+                    bDeserialized = true;
+                }
 
-        for (WrappedInput& NewInput : BundleInputs) {
-            const int32 NewBufferIndex = BufferIndex(NewInput.ServerTick);
-            if (Inputs[NewBufferIndex].ServerTick < NewInput.ServerTick) {
-                Inputs[NewBufferIndex] = NewInput;
+                BufferedInput = NewInput;
+                BufferedInput.ServerTick = Tick;
             }
         }
     }
 
+    template <typename Traits>
+    void USimInput<Traits>::UpdateAck(int32 FirstReceivedTick) {
+        FScopeLock AckLock(&AckMutex);
+
+        // Inputs for ticks that were already simulated are of no use anymore, so they are acknowledged whether they arrived or not.
+        int32 AckedTick = PendingAck.AckedTick == INDEX_NONE ? FirstReceivedTick - 1 : PendingAck.AckedTick;
+        AckedTick = FMath::Max(AckedTick, LastSimulatedTick);
+
+        for (int32 Checked = 0; Checked < Inputs.Num() && Inputs[BufferIndex(AckedTick + 1)].ServerTick == AckedTick + 1; ++Checked) {
+            ++AckedTick;
+        }
+
+        PendingAck.AckedTick = AckedTick;
+        PendingAck.LossRate = LossEstimator.GetLossRate();
+    }
+
+    template <typename Traits>
+    void USimInput<Traits>::ConsumeInputAck(const FInputAck& Ack) {
+        FScopeLock SendLock(&SendMutex);
+        if (Ack.AckedTick > LatestAck.AckedTick) {
+            const FEncodedInput* AckedInput = SendWindow.FindByPredicate([&](const FEncodedInput& Encoded) { return Encoded.ServerTick == Ack.AckedTick; });
+            if (AckedInput != nullptr) {
+                AckRoundTripSends = AckedInput->NumSends;
+            }
+        }
+
+        LatestAck.AckedTick = FMath::Max(LatestAck.AckedTick, Ack.AckedTick);
+        LatestAck.LossRate = Ack.LossRate;
+    }
+
     template <typename Traits>
     void USimInput<Traits>::InjectInputsGT() {
         FScopeLock GTInputLock(&GTInputMutex);
@@ -128,21 +230,7 @@ namespace ClientPrediction {
         }
 
         // We always use the server tick to find the input to use. This way if the server offset changes, the right input will still be picked.
-        int32 BestInputIndex = INDEX_NONE;
-        for (int32 Index = 0; Index < Inputs.Num(); ++Index) {
-            const WrappedInput& Input = Inputs[Index];
-            if (Input.ServerTick > TickInfo.ServerTick) { continue; }
-
-            if (Input.ServerTick == TickInfo.ServerTick) {
-                BestInputIndex = Index;
-                break;
-            }
-
-            if (BestInputIndex == INDEX_NONE || Inputs[BestInputIndex].ServerTick < Input.ServerTick) {
-                BestInputIndex = Index;
-            }
-        }
-
+        const int32 BestInputIndex = FindBestInputIndex(TickInfo.ServerTick);
         if (BestInputIndex != INDEX_NONE) {
             CurrentInput = Inputs[BestInputIndex];
         }
@@ -151,6 +239,10 @@ namespace ClientPrediction {
             FScopeLock SendLock(&SendMutex);
             PendingSend.Add(CurrentInput);
         }
+
+        if (TickInfo.SimRole == ROLE_Authority && TickInfo.bHasNetConnection && !TickInfo.bIsResim) {
+            LastSimulatedTick = FMath::Max(LastSimulatedTick, TickInfo.ServerTick);
+        }
     }
 
     template <typename Traits>
@@ -160,18 +252,93 @@ namespace ClientPrediction {
             return;
         }
 
-        int32 SendWindowMaxSize = FMath::Max(PendingSend.Num(), ClientPredictionInputWindowSize);
-        SendWindow.Append(PendingSend);
+        for (WrappedInput& Input : PendingSend) {
+            if (Input.ServerTick <= LatestAck.AckedTick) { continue; }
 
-        while (SendWindow.Num() > SendWindowMaxSize) {
-            SendWindow.RemoveAt(0);
-        }
+            // Inputs are only encoded once when they enter the window. Entries that left the window are reused so that their buffers are kept.
+            FEncodedInput Encoded = FreeEncodedInputs.IsEmpty() ? FEncodedInput{} : FreeEncodedInputs.Pop(EAllowShrinking::No);
+            EncodeInput(Input, Encoded);
+            Encoded.EncodeDelta(SendWindow.IsEmpty() ? nullptr : &SendWindow.Last());
+            Encoded.NumSends = 0;
 
-        FBundledPackets Packets{};
-        Packets.Bundle().Store(SendWindow, this);
+            SendWindow.Add(MoveTemp(Encoded));
+        }
 
-        EmitInputBundleDelegate.ExecuteIfBound(Packets);
         PendingSend.Reset();
+
+        // Inputs that the authority already has don't need to be sent again. The rest are kept until their ack is overdue, since a lost bundle is only
+        // reflected in the reported loss once the authority notices it. Until the first ack arrives, they are kept for the whole window.
+        const int32 MaxSends = FMath::Max(ClientPredictionInputWindowSize, 1);
+        const int32 RoundTripSends = AckRoundTripSends != INDEX_NONE ? FMath::Min(AckRoundTripSends + 1, MaxSends) : MaxSends;
+        const int32 Redundancy = FMath::Max(FInputLossEstimator::GetRedundancy(LatestAck.LossRate), RoundTripSends);
+        for (int32 Index = SendWindow.Num() - 1; Index >= 0; --Index) {
+            const FEncodedInput& Encoded = SendWindow[Index];
+            if (Encoded.ServerTick > LatestAck.AckedTick && Encoded.NumSends < Redundancy) { continue; }
+
+            FreeEncodedInputs.Add(MoveTemp(SendWindow[Index]));
+            SendWindow.RemoveAt(Index, 1, EAllowShrinking::No);
+        }
+
+        if (SendWindow.IsEmpty()) { return; }
+
+        for (FEncodedInput& Encoded : SendWindow) {
+            ++Encoded.NumSends;
+        }
+
+        ++SendContext.Sequence;
+        SendRuns.Reset();
+        FInputWindowContext::BuildRuns(SendWindow, SendRuns);
+
+        SendPackets.Bundle().StoreSplit(SendRuns, &SendContext, [&]() { EmitInputBundleDelegate.ExecuteIfBound(SendPackets); });
+    }
+
+    template <typename Traits>
+    void USimInput<Traits>::EmitInputAck() {
+        FInputAck Ack{};
+        {
+            FScopeLock AckLock(&AckMutex);
+            if (PendingAck.AckedTick == INDEX_NONE) { return; }
+
+            Ack = PendingAck;
+        }
+
+        EmitInputAckDelegate.ExecuteIfBound(Ack);
+    }
+
+    template <typename Traits>
+    void USimInput<Traits>::EncodeInput(WrappedInput& Input, FEncodedInput& OutEncoded) {
+        FNetBitWriter& Writer = FScratchArchives::GetWriter(WrappedInput::GetMaxInputBits());
+        Input.SerializeInput(Writer);
+
+        OutEncoded.ServerTick = Input.ServerTick;
+        OutEncoded.NumBits = static_cast<int32>(Writer.GetNumBits());
+        OutEncoded.Bytes.Reset();
+        OutEncoded.Bytes.Append(Writer.GetData(), Writer.GetNumBytes());
+    }
+
+    template <typename Traits>
+    const typename Traits::InputType* USimInput<Traits>::FindInput(int32 ServerTick) const {
+        const int32 BestInputIndex = FindBestInputIndex(ServerTick);
+        return BestInputIndex != INDEX_NONE ? &Inputs[BestInputIndex].Input : nullptr;
+    }
+
+    template <typename Traits>
+    int32 USimInput<Traits>::FindBestInputIndex(int32 ServerTick) const {
+        int32 BestInputIndex = INDEX_NONE;
+        for (int32 Index = 0; Index < Inputs.Num(); ++Index) {
+            const WrappedInput& Input = Inputs[Index];
+            if (Input.ServerTick > ServerTick) { continue; }
+
+            if (Input.ServerTick == ServerTick) {
+                return Index;
+            }
+
+            if (BestInputIndex == INDEX_NONE || Inputs[BestInputIndex].ServerTick < Input.ServerTick) {
+                BestInputIndex = Index;
+            }
+        }
+
+        return BestInputIndex;
     }
 
     template <typename Traits>
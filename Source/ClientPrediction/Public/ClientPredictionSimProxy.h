@@ -5,6 +5,8 @@
 #include "ClientPredictionTick.h"
 #include "ClientPredictionSimProxy.generated.h"
 
+struct FBundledPackets;
+
 USTRUCT()
 struct FRemoteSimProxyOffset {
     GENERATED_BODY()
@@ -48,11 +50,16 @@ public:
     int32 GetLocalToServerOffset() const;
     const TOptional<FRemoteSimProxyOffset>& GetRemoteSimProxyOffset() const;
 
+    /** Queues unreliable events of a sim on the authority with the connection channel of every client. Returns false if there are no connection channels. */
+    bool QueueEvents(class UClientPredictionV2Component* Component, const FBundledPackets& Bundle);
+
 private:
     UFUNCTION()
     void LatestServerTickChangedGT();
     void LatestServerTickChangedPT(const int32 TickToProcess);
 
+    void UpdateConnectionChannels();
+
     UPROPERTY(ReplicatedUsing=LatestServerTickChangedGT)
     int32 LatestServerTick = INDEX_NONE;
 
@@ -62,6 +69,8 @@ private:
     int32 LocalToServerOffset = INDEX_NONE;
     TOptional<FRemoteSimProxyOffset> RemoteSimProxyOffset{};
 
+    TMap<TWeakObjectPtr<class APlayerController>, TWeakObjectPtr<class AClientPredictionConnectionChannel>> ConnectionChannels;
+
 public:
     DECLARE_MULTICAST_DELEGATE_OneParam(FRemoteSimProxyOffsetChangedDelegate, const TOptional<FRemoteSimProxyOffset>& Offset)
     FRemoteSimProxyOffsetChangedDelegate RemoteSimProxyOffsetChangedDelegate;
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "ClientPrediction.h"
+#include "Containers/SpscQueue.h"
 #include "PhysicsProxy/SingleParticlePhysicsProxy.h"
 #include "Chaos/PhysicsObjectInterface.h"
 #include "Chaos/PhysicsObjectInternalInterface.h"
@@ -8,11 +9,23 @@
 #include "ClientPredictionDelegate.h"
 #include "ClientPredictionNetSerialization.h"
 #include "ClientPredictionSimEvents.h"
+#include "ClientPredictionStateHistory.h"
+#include "ClientPredictionStats.h"
 #include "ClientPredictionTick.h"
 #include "ClientPredictionPhysState.h"
 #include "ClientPredictionCVars.h"
+#include "ClientPredictionSchema.h"
 
 namespace ClientPrediction {
+    /** The userdata of state bundles. Every state in a bundle shares the anchor that kLow physics states are written relative to. */
+    struct FStateBundleContext {
+        /** Passed on to FWrappedState::SerializeState(). */
+        void* SerializeStateUserdata = nullptr;
+        FPhysStateAnchor Anchor{};
+
+        void BeginBundle() { Anchor.Reset(); }
+    };
+
     template <typename Traits>
     struct FWrappedState {
         using StateType = typename Traits::StateType;
@@ -28,15 +41,28 @@ namespace ClientPrediction {
         Chaos::FReal StartTime = 0.0;
         Chaos::FReal EndTime = 0.0;
 
-        void NetSerialize(FArchive& Ar, EDataCompleteness Completeness, void* Userdata);
+        void NetSerialize(FArchive& Ar, EDataCompleteness Completeness, FStateBundleContext* Context);
         void Interpolate(const FWrappedState& Other, Chaos::FReal Alpha);
         void Extrapolate(const FWrappedState& PrevState, Chaos::FReal StateDt, Chaos::FReal ExtrapolationTime);
+
+        /** These go through Traits::StateSchema if there is one, otherwise through the serialize function passed as Userdata and the methods on StateType. */
+        static void SerializeState(StateType& State, FArchive& Ar, EDataCompleteness Completeness, void* Userdata);
+        static bool ShouldReconcileState(const StateType& State, const StateType& Other);
+
+        /**
+         * Whether correcting Predicted to Corrected can change what physics does, in which case physics needs to be resimulated and the state can't just be
+         * replayed. Traits can narrow this down with a static ShouldResimulatePhysics(Predicted, Corrected), otherwise any change that would be reconciled
+         * counts.
+         */
+        static bool ShouldResimulatePhysics(const StateType& Predicted, const StateType& Corrected);
+
+        static constexpr int64 GetMaxSerializedBits(EDataCompleteness Completeness) requires CHasStateSchema<Traits> {
+            return 32 + FPhysState::GetMaxSerializedBits(Completeness) + Traits::StateSchema.GetMaxBits(Completeness);
+        }
     };
 
     template <typename Traits>
-    void FWrappedState<Traits>::NetSerialize(FArchive& Ar, EDataCompleteness Completeness, void* Userdata) {
-        auto& NetSerialize = *static_cast<TFunction<void(StateType&, FArchive& Ar, ClientPrediction::EDataCompleteness)>*>(Userdata);
-
+    void FWrappedState<Traits>::NetSerialize(FArchive& Ar, EDataCompleteness Completeness, FStateBundleContext* Context) {
         if (Ar.IsSaving()) {
             checkSlow(ServerTick >= INDEX_NONE);
 
@@ -51,14 +77,51 @@ namespace ClientPrediction {
             bIsFinalState = static_cast<bool>(Packed >> 31);
         }
 
-        PhysState.NetSerialize(Ar, Completeness);
-        NetSerialize(State, Ar, Completeness);
+        PhysState.NetSerialize(Ar, Completeness, &Context->Anchor);
+        SerializeState(State, Ar, Completeness, Context->SerializeStateUserdata);
     }
 
     template <typename Traits>
     void FWrappedState<Traits>::Interpolate(const FWrappedState& Other, Chaos::FReal Alpha) {
         PhysState.Interpolate(Other.PhysState, Alpha);
-        State.Interpolate(Other.State, Alpha);
+
+        if constexpr (CHasStateSchema<Traits>) {
+            Traits::StateSchema.Interpolate(State, Other.State, Alpha);
+        }
+        else {
+            State.Interpolate(Other.State, Alpha);
+        }
+    }
+
+    template <typename Traits>
+    void FWrappedState<Traits>::SerializeState(StateType& State, FArchive& Ar, EDataCompleteness Completeness, void* Userdata) {
+        if constexpr (CHasStateSchema<Traits>) {
+            Traits::StateSchema.NetSerialize(State, Ar, Completeness);
+        }
+        else {
+            auto& NetSerialize = *static_cast<TFunction<void(StateType&, FArchive& Ar, ClientPrediction::EDataCompleteness)>*>(Userdata);
+            NetSerialize(State, Ar, Completeness);
+        }
+    }
+
+    template <typename Traits>
+    bool FWrappedState<Traits>::ShouldReconcileState(const StateType& State, const StateType& Other) {
+        if constexpr (CHasStateSchema<Traits>) {
+            return Traits::StateSchema.ShouldReconcile(State, Other);
+        }
+        else {
+            return State.ShouldReconcile(Other);
+        }
+    }
+
+    template <typename Traits>
+    bool FWrappedState<Traits>::ShouldResimulatePhysics(const StateType& Predicted, const StateType& Corrected) {
+        if constexpr (requires { Traits::ShouldResimulatePhysics(Predicted, Corrected); }) {
+            return Traits::ShouldResimulatePhysics(Predicted, Corrected);
+        }
+        else {
+            return ShouldReconcileState(Predicted, Corrected);
+        }
     }
 
     template <typename Traits>
@@ -97,7 +160,7 @@ namespace ClientPrediction {
 
         void SetSimDelegates(const TSharedPtr<FSimDelegates<Traits>>& NewSimDelegates);
         void SetSimEvents(const TSharedPtr<USimEvents>& NewSimEvents);
-        void SetBufferSize(int32 BufferSize);
+        void SetBufferSize(ENetRole SimRole, int32 RewindCapacity);
 
     private:
         TSharedPtr<FSimDelegates<Traits>> SimDelegates;
@@ -108,8 +171,19 @@ namespace ClientPrediction {
         void ConsumeAutoProxyStates(const FBundledPacketsFull& Packets);
         void ConsumeFinalState(const FBundledPacketsFull& Packets, const FNetTickInfo& TickInfo);
 
+        /**
+         * Decodes a sim proxy bundle whose decoding was deferred and queues its states to be inserted into the history on the physics thread. This can
+         * run on any thread, but only one bundle can be decoded at a time.
+         */
+        void DecodeSimProxyStates(const FBundledPacketsLow& Packets, Chaos::FReal SimDt);
+
+        /** The baseline acks of bundles decoded with DecodeSimProxyStates(), dequeued on the game thread. */
+        TOptional<uint32> DequeueSimProxyStatesAck() { return DecodedSimProxyStatesAcks.Dequeue(); }
+
     private:
         void UpdateTimesRecvSimProxy(WrappedState& State, Chaos::FReal SimDt);
+        void InsertSimProxyStates(TArray<WrappedState>& States);
+        void ConsumeDecodedSimProxyStates();
 
     private:
         static void FillStateSimDetails(WrappedState& State, const FNetTickInfo& TickInfo);
@@ -121,7 +195,6 @@ namespace ClientPrediction {
 
     private:
         bool CanSimBeCleanedUp(const FNetTickInfo& TickInfo);
-        void TrimStateBuffer();
 
     public:
         void TickPrePhysics(const FNetTickInfo& TickInfo, const InputType& Input);
@@ -129,6 +202,7 @@ namespace ClientPrediction {
 
     private:
         void UpdateStateHistory(const FNetTickInfo& TickInfo, const WrappedState& State);
+        void PublishState(int32 Tick, const WrappedState& State);
 
         bool IsSimOverPT(const FNetTickInfo& TickInfo);
         void EndSimIfNeeded(const FNetTickInfo& TickInfo);
@@ -136,34 +210,107 @@ namespace ClientPrediction {
 
     public:
         int32 GetRewindTick(Chaos::FPhysicsSolver* PhysSolver, Chaos::FPhysicsObjectHandle PhysObject);
+
+        /** The first tick that needs to be replayed because only the state diverged from the authority, or INDEX_NONE. */
+        int32 GetStateReplayTick() const { return PendingStateReplayTick; }
+
+        /**
+         * Replays the sim delegates from the state replay tick. If a replayed state differs from the predicted one in a way that matters to physics, the
+         * replay stops and a resim is queued from there instead. Returns the tick of that resim, or INDEX_NONE.
+         */
+        int32 ReplayState(const FNetTickInfo& CurrentTickInfo, Chaos::FPhysicsSolver* PhysSolver, Chaos::FPhysicsObjectHandle PhysObject,
+                          TFunctionRef<const InputType*(int32 ServerTick)> FindInput);
         void ApplyCorrectionIfNeeded(const FNetTickInfo& TickInfo);
 
+    private:
+        /** Queues a resim starting right after CorrectedState, which is written to the history. Returns the tick of the resim or INDEX_NONE if it is blocked. */
+        int32 QueueRewind(Chaos::FPhysicsSolver* PhysSolver, Chaos::FPhysicsObjectHandle PhysObject, const WrappedState& CorrectedState);
+
+    public:
+
         void EmitStates();
         void InterpolateGameThread(UPrimitiveComponent* UpdatedComponent, Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, Chaos::FReal Dt, ENetRole SimRole);
 
     private:
+        void ConsumePublishedStates();
+        void SerializeForHistory(WrappedState& State, FArchive& Ar);
+
+        /** The origin that positions and times are stored relative to in a compact history. It is taken from the first state written to the history. */
+        struct FCompactHistoryOrigin {
+            Chaos::FVec3 X = Chaos::FVec3::ZeroVector;
+            Chaos::FReal TimeOrigin = 0.0;
+            Chaos::FReal Dt = 0.0;
+            bool bIsSet = false;
+        };
+
+        void SerializeCompactForHistory(FCompactHistoryOrigin& Origin, int32 Tick, WrappedState& State, FArchive& Ar);
         void GetInterpolatedStateAtTime(Chaos::FReal ResultsTime, WrappedState& OutState);
         static Chaos::FRigidBodyHandle_Internal* GetPhysHandle(const FNetTickInfo& TickInfo);
 
     public:
-        const StateType& GetPrevState() { return PrevState.State; }
+        const StateType& GetPrevState() { return PrevState->State; }
 
     private:
         TFunction<void(StateType&, FArchive& Ar, ClientPrediction::EDataCompleteness)> NetSerialize;
 
-        FCriticalSection StateMutex;
-        TArray<WrappedState> StateHistory;
-        int32 StateHistoryCapacity = INDEX_NONE;
-
-        WrappedState PrevState{};
-        WrappedState CurrentState{};
+        // Bundles are stored on the game thread and retrieved on the physics thread, so each side has its own context
+        FStateBundleContext SendContext;
+        FStateBundleContext ReceiveContext;
+
+        // Only accessed on the physics thread
+        TStateHistory<WrappedState> StateHistory;
+
+        FCompactHistoryOrigin CompactHistoryOrigin;
+        FCompactHistoryOrigin CompactGameThreadHistoryOrigin;
+
+        /** Sims are only cleaned up once they are far enough in the past that a rewind can't reach them. */
+        int32 CleanupDelayTicks = 0;
+
+        /** This sits before every tick in the history and is used until the first tick has been simulated. */
+        WrappedState InitialState{};
+
+        struct FPublishedState {
+            /** INDEX_NONE is used to publish the initial state. */
+            int32 Tick = INDEX_NONE;
+            WrappedState State{};
+        };
+
+        /**
+         * Every state written to the history on the physics thread is published through this lock-free queue and copied into a history owned by the game
+         * thread. This way interpolation and emitting states never have to wait on the physics thread (or the other way around).
+         */
+        TSpscQueue<FPublishedState> PublishedStates;
+        TStateHistory<WrappedState> GameThreadHistory;
+
+        // Reused for every bundle so that sending and receiving states doesn't allocate in steady state. The packets are only used on the game thread and
+        // the received states only on the physics thread.
+        FBundledPacketsLow SimProxyPackets;
+        FBundledPacketsFull AutoProxyPackets;
+        FBundledPacketsFull FinalStatePackets;
+        TArray<WrappedState> ReceivedStates;
+        TOptional<WrappedState> GameThreadInitialState;
+
+        /** Sim proxy states decoded off the game thread, which the physics thread only has to insert into the history. */
+        TSpscQueue<TArray<WrappedState>> DecodedSimProxyStates;
+        TSpscQueue<uint32> DecodedSimProxyStatesAcks;
+
+        /**
+         * These point into the history (or at the initial state) rather than holding copies. They are only valid between PreparePrePhysics() and
+         * TickPostPhysics() of the same tick, which is enough since nothing else is written to the history in between.
+         */
+        const WrappedState* PrevState = &InitialState;
+        WrappedState* CurrentState = nullptr;
         WrappedState LastInterpolatedState{};
+        int32 LatestInterpolatedTick = INDEX_NONE;
         TAtomic<bool> bGeneratedInitialState = false;
 
         TAtomic<bool> bEndedSimOnGameThread = false;
         FCriticalSection FinalStateMutex;
         WrappedState FinalState{};
 
+        /** Mirrors FinalState.LocalTick so that checking whether the sim is over doesn't need to take FinalStateMutex every tick. */
+        TAtomic<int32> FinalLocalTick = INDEX_NONE;
+
         // Relevant only for sim proxies
         ECollisionEnabled::Type CachedCollisionMode = ECollisionEnabled::NoCollision;
 
@@ -172,6 +319,7 @@ namespace ClientPrediction {
         int32 LatestAckedServerTick = INDEX_NONE;
 
         TOptional<WrappedState> PendingCorrection;
+        int32 PendingStateReplayTick = INDEX_NONE;
         bool bAutoProxyAppliedFinalState = false;
 
         // Relevant only for the authorities
@@ -179,7 +327,10 @@ namespace ClientPrediction {
     };
 
     template <typename Traits>
-    USimState<Traits>::USimState(const TFunction<void(StateType&, FArchive& Ar, ClientPrediction::EDataCompleteness)>& NetSerialize) : NetSerialize(NetSerialize) {}
+    USimState<Traits>::USimState(const TFunction<void(StateType&, FArchive& Ar, ClientPrediction::EDataCompleteness)>& NetSerialize) : NetSerialize(NetSerialize) {
+        SendContext.SerializeStateUserdata = &this->NetSerialize;
+        ReceiveContext.SerializeStateUserdata = &this->NetSerialize;
+    }
 
     template <typename Traits>
     void USimState<Traits>::SetSimDelegates(const TSharedPtr<FSimDelegates<Traits>>& NewSimDelegates) {
@@ -192,53 +343,134 @@ namespace ClientPrediction {
     }
 
     template <typename Traits>
-    void USimState<Traits>::SetBufferSize(int32 BufferSize) {
-        StateHistoryCapacity = BufferSize;
+    void USimState<Traits>::SetBufferSize(ENetRole SimRole, int32 RewindCapacity) {
+        using FHistorySerializer = typename TStateHistory<WrappedState>::FSerializer;
+        const int32 KeyframeInterval = ClientPredictionHistoryKeyframeInterval;
+
+        FHistorySerializer Serializer{}, GameThreadSerializer{};
+        if (KeyframeInterval > 1) {
+            Serializer = [this](int32 Tick, WrappedState& State, FArchive& Ar) { SerializeForHistory(State, Ar); };
+            GameThreadSerializer = Serializer;
+        }
+
+        // Clients only use the game thread history for interpolation, so it doesn't need full precision. The physics history of auto proxies is written
+        // in place every tick and is kept in full.
+        if (ClientPredictionCompactClientHistory && SimRole != ROLE_Authority) {
+            GameThreadSerializer = [this](int32 Tick, WrappedState& State, FArchive& Ar) {
+                SerializeCompactForHistory(CompactGameThreadHistoryOrigin, Tick, State, Ar);
+            };
+
+            if (SimRole == ROLE_SimulatedProxy) {
+                Serializer = [this](int32 Tick, WrappedState& State, FArchive& Ar) { SerializeCompactForHistory(CompactHistoryOrigin, Tick, State, Ar); };
+            }
+        }
+
+        StateHistory.SetSerializedStorage(Serializer, KeyframeInterval);
+        GameThreadHistory.SetSerializedStorage(GameThreadSerializer, KeyframeInterval);
+
+        // Only auto proxies rewind, so they are the only role that needs states going back the full rewind depth on the physics thread. The other roles only
+        // need enough history to cover the states that haven't been emitted or interpolated yet. Sim proxies also need to hold their interpolation buffer.
+        // The authority emits once per game thread frame and looks back to the last state on each send interval, so it keeps a full interval on top of the
+        // window. A frame that takes longer than the window still loses the oldest states, which EmitStates() reports.
+        int32 WindowTicks = ClientPredictionHistoryWindowTicks;
+        if (SimRole == ROLE_SimulatedProxy) {
+            WindowTicks += ClientPredictionSimProxyBufferTicks + ClientPredictionSimProxySendInterval;
+        }
+        else if (SimRole == ROLE_Authority) {
+            WindowTicks += FMath::Max(ClientPredictionSimProxySendInterval, ClientPredictionAutoProxySendInterval);
+        }
+
+        WindowTicks = FMath::Clamp(WindowTicks, 2, FMath::Max(RewindCapacity, 2));
+        StateHistory.SetCapacity(SimRole == ROLE_AutonomousProxy ? FMath::Max(RewindCapacity, 2) : WindowTicks);
+        GameThreadHistory.SetCapacity(WindowTicks);
+
+        CleanupDelayTicks = RewindCapacity;
     }
 
     template <typename Traits>
     void USimState<Traits>::ConsumeSimProxyStates(const FBundledPacketsLow& Packets, Chaos::FReal SimDt) {
-        FScopeLock StateLock(&StateMutex);
-        TArray<WrappedState> AuthorityStates;
-        Packets.Bundle().Retrieve(AuthorityStates, &NetSerialize);
+        ReceivedStates.Reset();
+        Packets.Bundle().Retrieve(ReceivedStates, &ReceiveContext);
 
-        for (WrappedState& NewState : AuthorityStates) {
-            if (StateHistory.ContainsByPredicate([&](const WrappedState& Other) { return Other.ServerTick == NewState.ServerTick; })) {
-                continue;
-            }
+        for (WrappedState& NewState : ReceivedStates) {
+            UpdateTimesRecvSimProxy(NewState, SimDt);
+        }
+
+        InsertSimProxyStates(ReceivedStates);
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::DecodeSimProxyStates(const FBundledPacketsLow& Packets, Chaos::FReal SimDt) {
+        if (!Packets.Bundle().DecodePayload()) { return; }
+
+        const TOptional<uint32>& BaselineAck = Packets.Bundle().GetBaselineAck();
+        if (BaselineAck.IsSet()) {
+            DecodedSimProxyStatesAcks.Enqueue(BaselineAck.GetValue());
+        }
+
+        // ReceiveContext belongs to the physics thread, so this uses its own.
+        FStateBundleContext DecodeContext{};
+        DecodeContext.SerializeStateUserdata = &this->NetSerialize;
+
+        TArray<WrappedState> States;
+        Packets.Bundle().Retrieve(States, &DecodeContext);
+        if (States.IsEmpty()) { return; }
 
+        for (WrappedState& NewState : States) {
             UpdateTimesRecvSimProxy(NewState, SimDt);
-            StateHistory.Add(MoveTemp(NewState));
         }
 
-        StateHistory.Sort([](const WrappedState& Lhs, const WrappedState& Rhs) { return Lhs.ServerTick < Rhs.ServerTick; });
+        DecodedSimProxyStates.Enqueue(MoveTemp(States));
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::ConsumeDecodedSimProxyStates() {
+        while (TOptional<TArray<WrappedState>> States = DecodedSimProxyStates.Dequeue()) {
+            InsertSimProxyStates(States.GetValue());
+        }
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::InsertSimProxyStates(TArray<WrappedState>& States) {
+        // Sim proxies key their history by server tick since they never simulate locally.
+        for (WrappedState& NewState : States) {
+            if (StateHistory.Contains(NewState.ServerTick)) {
+                continue;
+            }
+
+            if (StateHistory.Insert(NewState.ServerTick, NewState)) {
+                PublishState(NewState.ServerTick, NewState);
+            }
+        }
     }
 
     template <typename Traits>
     void USimState<Traits>::ConsumeAutoProxyStates(const FBundledPacketsFull& Packets) {
-        TArray<WrappedState> AuthorityStates;
-        Packets.Bundle().Retrieve(AuthorityStates, &NetSerialize);
+        ReceivedStates.Reset();
+        Packets.Bundle().Retrieve(ReceivedStates, &ReceiveContext);
 
-        if (AuthorityStates.IsEmpty() || AuthorityStates.Last().ServerTick <= LatestAuthorityState.ServerTick) { return; }
-        LatestAuthorityState = AuthorityStates.Last();
+        if (ReceivedStates.IsEmpty() || ReceivedStates.Last().ServerTick <= LatestAuthorityState.ServerTick) { return; }
+        LatestAuthorityState = ReceivedStates.Last();
     }
 
     template <typename Traits>
     void USimState<Traits>::ConsumeFinalState(const FBundledPacketsFull& Packets, const FNetTickInfo& TickInfo) {
         FScopeLock FinalStateLock(&FinalStateMutex);
-        FScopeLock StateLock(&StateMutex);
 
-        TArray<WrappedState> AuthorityState;
-        Packets.Bundle().Retrieve(AuthorityState, &NetSerialize);
+        ReceivedStates.Reset();
+        Packets.Bundle().Retrieve(ReceivedStates, &ReceiveContext);
 
-        check(AuthorityState.Num() == 1);
-        FinalState = AuthorityState[0];
+        check(ReceivedStates.Num() == 1);
+        FinalState = ReceivedStates[0];
 
         if (TickInfo.SimRole == ROLE_SimulatedProxy) {
             UpdateTimesRecvSimProxy(FinalState, TickInfo.Dt);
 
-            // The final state should always be the last. Plus we sort in ConsumeSimProxyStates() so it shouldn't be a problem if another state is received after.
-            StateHistory.Add(FinalState);
+            // The final state should always be the last, so anything that was received after it is dropped.
+            StateHistory.Insert(FinalState.ServerTick, FinalState);
+            StateHistory.TruncateAfter(FinalState.ServerTick);
+
+            PublishState(FinalState.ServerTick, FinalState);
             return;
         }
 
@@ -246,6 +478,7 @@ namespace ClientPrediction {
         // that the simulation will end on the client. If it does change, this simulation doesn't really care because it's already over on the authority. This offset
         // will most likely be negative since the client predicts ahead of the authority.
         FinalState.LocalTick = TickInfo.LocalTick + (FinalState.ServerTick - TickInfo.ServerTick);
+        FinalLocalTick = FinalState.LocalTick;
     }
 
     template <typename Traits>
@@ -287,13 +520,11 @@ namespace ClientPrediction {
     void USimState<Traits>::GenerateInitialState(const FNetTickInfo& TickInfo) {
         if (SimDelegates == nullptr) { return; }
 
-        FScopeLock StateLock(&StateMutex);
-
         // We can leave the frame indexes and times as invalid because this is just a starting off point until we get the first valid frame
-        USimState::FillStatePhysInfo(CurrentState, TickInfo);
-        SimDelegates->GenerateInitialStatePTDelegate.Broadcast(CurrentState.State);
+        USimState::FillStatePhysInfo(InitialState, TickInfo);
+        SimDelegates->GenerateInitialStatePTDelegate.Broadcast(InitialState.State);
 
-        StateHistory.Add(CurrentState);
+        PublishState(INDEX_NONE, InitialState);
     }
 
     template <typename Traits>
@@ -309,29 +540,18 @@ namespace ClientPrediction {
         }
 
         if (TickInfo.SimRole == ROLE_SimulatedProxy) {
+            ConsumeDecodedSimProxyStates();
             return bEndedSimOnGameThread ? ESimStage::kEnded : ESimStage::kRunning;
         }
 
-        // We need to unlock the state mutex before checking if the sim is over to prevent deadlock since everything is done final state then state lock.
-        {
-            FScopeLock StateLock(&StateMutex);
-            TrimStateBuffer();
-        }
-
         if (IsSimOverPT(TickInfo)) {
             return ESimStage::kEnded;
         }
 
-        FScopeLock StateLock(&StateMutex);
         ApplyCorrectionIfNeeded(TickInfo);
 
-        const int32 PrevTickNumber = TickInfo.LocalTick - 1;
-        for (const WrappedState& State : StateHistory) {
-            if (State.LocalTick > PrevTickNumber) { break; }
-
-            PrevState = State;
-            if (State.LocalTick == PrevTickNumber) { break; }
-        }
+        const WrappedState* LatestState = StateHistory.FindLatestAtOrBefore(TickInfo.LocalTick - 1);
+        PrevState = LatestState != nullptr ? LatestState : &InitialState;
 
         return ESimStage::kRunning;
     }
@@ -344,17 +564,8 @@ namespace ClientPrediction {
             return true;
         }
 
-        FScopeLock FinalStateLock(&FinalStateMutex);
-        return FinalState.LocalTick != INDEX_NONE && TickInfo.LocalTick > FinalState.LocalTick + StateHistory.Num();
-    }
-
-    template <typename Traits>
-    void USimState<Traits>::TrimStateBuffer() {
-        if (StateHistoryCapacity == INDEX_NONE) { return; }
-
-        while (StateHistory.Num() > StateHistoryCapacity) {
-            StateHistory.RemoveAt(0, EAllowShrinking::No);
-        }
+        const int32 FinalTick = FinalLocalTick;
+        return FinalTick != INDEX_NONE && TickInfo.LocalTick > FinalTick + CleanupDelayTicks;
     }
 
     template <typename Traits>
@@ -366,77 +577,80 @@ namespace ClientPrediction {
             return;
         }
 
-        CurrentState.State = PrevState.State;
+        // The new state is written straight into its slot in the history, so the only copy made is seeding it with the previous state.
+        CurrentState = &StateHistory.Emplace(TickInfo.LocalTick);
+        CurrentState->State = PrevState->State;
+        CurrentState->bIsFinalState = false;
 
-        FTickOutput Output(CurrentState.State, TickInfo, SimEvents);
-        SimDelegates->SimTickPrePhysicsDelegate.Broadcast(TickInfo, Input, PrevState.State, Output);
+        FTickOutput Output(CurrentState->State, TickInfo, SimEvents);
+        SimDelegates->SimTickPrePhysicsDelegate.Broadcast(TickInfo, Input, PrevState->State, Output);
     }
 
     template <typename Traits>
     void USimState<Traits>::TickPostPhysics(const FNetTickInfo& TickInfo, const InputType& Input) {
         if (SimDelegates == nullptr || TickInfo.SimRole == ROLE_SimulatedProxy) { return; }
+        if (CurrentState == nullptr) { return; }
 
+        // The final state can be consumed between the pre and post physics ticks, in which case the state emplaced by TickPrePhysics() never happened.
         if (IsSimOverPT(TickInfo)) {
+            StateHistory.Discard(TickInfo.LocalTick);
+            CurrentState = nullptr;
             return;
         }
 
-        FTickOutput Output(CurrentState.State, TickInfo, SimEvents);
-        SimDelegates->SimTickPostPhysicsDelegate.Broadcast(TickInfo, Input, PrevState.State, Output);
-        USimState::FillStateSimDetails(CurrentState, TickInfo);
+        FTickOutput Output(CurrentState->State, TickInfo, SimEvents);
+        SimDelegates->SimTickPostPhysicsDelegate.Broadcast(TickInfo, Input, PrevState->State, Output);
+        USimState::FillStateSimDetails(*CurrentState, TickInfo);
 
-        UpdateStateHistory(TickInfo, CurrentState);
+        StateHistory.Commit(TickInfo.LocalTick);
+        PublishState(TickInfo.LocalTick, *CurrentState);
+        CurrentState = nullptr;
     }
 
     template <typename Traits>
     void USimState<Traits>::UpdateStateHistory(const FNetTickInfo& TickInfo, const WrappedState& State) {
-        FScopeLock StateLock(&StateMutex);
-        if (StateHistory.IsEmpty() || StateHistory.Last().LocalTick < TickInfo.LocalTick) {
-            StateHistory.Add(State);
-            return;
-        }
+        StateHistory.Insert(TickInfo.LocalTick, State);
 
-        for (int32 StateIdx = 0; StateIdx < StateHistory.Num(); ++StateIdx) {
-            WrappedState& HistoricState = StateHistory[StateIdx];
-            if (HistoricState.LocalTick != TickInfo.LocalTick) {
-                continue;
-            }
+        // Auto proxies were probably ahead of the authority, so there were most likely states that were predicted after the end of the simulation.
+        // These states never actually happened on the authority , so we want to remove them.
+        if (State.bIsFinalState) {
+            StateHistory.TruncateAfter(TickInfo.LocalTick);
+        }
 
-            HistoricState = State;
-            if (!State.bIsFinalState) {
-                return;
-            }
+        PublishState(TickInfo.LocalTick, State);
+    }
 
-            // Auto proxies were probably ahead of the authority, so there were most likely states that were predicted after the end of the simulation.
-            // These states never actually happened on the authority , so we want to remove them.
-            const int32 NextStateIdx = StateIdx + 1;
-            while (StateHistory.Num() > NextStateIdx) {
-                StateHistory.RemoveAt(NextStateIdx);
-            }
-        }
+    template <typename Traits>
+    void USimState<Traits>::PublishState(int32 Tick, const WrappedState& State) {
+        PublishedStates.Enqueue(FPublishedState{Tick, State});
+        INC_DWORD_STAT(STAT_ClientPredictionStatesPublished);
     }
 
     template <typename Traits>
     bool USimState<Traits>::IsSimOverPT(const FNetTickInfo& TickInfo) {
         // Auto proxies assign a local tick when the final state is consumed to avoid a changing server offset causing the simulation to report as not over for a few ticks.
         // Authorities can just use the local tick because for them LocalTick == ServerTick.
-        FScopeLock FinalStateLock(&FinalStateMutex);
-        return FinalState.LocalTick != INDEX_NONE && TickInfo.LocalTick >= FinalState.LocalTick;
+        const int32 FinalTick = FinalLocalTick;
+        return FinalTick != INDEX_NONE && TickInfo.LocalTick >= FinalTick;
     }
 
     template <typename Traits>
     void USimState<Traits>::EndSimIfNeeded(const FNetTickInfo& TickInfo) {
-        FScopeLock FinalStateLock(&FinalStateMutex);
-
-        if (TickInfo.SimRole == ROLE_AutonomousProxy && FinalState.LocalTick != INDEX_NONE && TickInfo.LocalTick >= FinalState.LocalTick) {
+        // The lock is only taken once the final state actually needs to be written, which happens at most once per sim.
+        const int32 FinalTick = FinalLocalTick;
+        if (TickInfo.SimRole == ROLE_AutonomousProxy && FinalTick != INDEX_NONE && TickInfo.LocalTick >= FinalTick) {
             if (bAutoProxyAppliedFinalState) { return; }
             bAutoProxyAppliedFinalState = true;
 
+            FScopeLock FinalStateLock(&FinalStateMutex);
+
             // Now that we know when the final state is actually applied, we can update all of the relevant values on it.
             FinalState.LocalTick = TickInfo.LocalTick;
             FinalState.ServerTick = TickInfo.ServerTick;
 
             FinalState.StartTime = TickInfo.StartTime;
             FinalState.EndTime = TickInfo.EndTime;
+            FinalLocalTick = FinalState.LocalTick;
 
             EndSimPT(TickInfo);
             UpdateStateHistory(TickInfo, FinalState);
@@ -445,17 +659,20 @@ namespace ClientPrediction {
         }
 
         // We only allow the authority to end the simulation so that the client doesn't mispredict and end it early.
-        if (TickInfo.SimRole != ROLE_Authority || FinalState.ServerTick != INDEX_NONE) {
+        if (TickInfo.SimRole != ROLE_Authority || FinalTick != INDEX_NONE) {
             return;
         }
 
-        if (!SimDelegates->IsSimFinishedDelegate.IsBound() || !SimDelegates->IsSimFinishedDelegate.Execute(TickInfo, PrevState.State)) {
+        if (!SimDelegates->IsSimFinishedDelegate.IsBound() || !SimDelegates->IsSimFinishedDelegate.Execute(TickInfo, PrevState->State)) {
             return;
         }
 
+        FScopeLock FinalStateLock(&FinalStateMutex);
+
         FinalState.bIsFinalState = true;
-        FinalState.State = PrevState.State;
+        FinalState.State = PrevState->State;
         USimState::FillStateSimDetails(FinalState, TickInfo);
+        FinalLocalTick = FinalState.LocalTick;
 
         UpdateStateHistory(TickInfo, FinalState);
         EndSimPT(TickInfo);
@@ -483,39 +700,57 @@ namespace ClientPrediction {
         Chaos::FRewindData* RewindData = PhysSolver->GetRewindData();
         if (RewindData == nullptr) { return INDEX_NONE; }
 
-        FScopeLock StateLock(&StateMutex);
-        WrappedState* HistoricState = nullptr;
-
-        for (WrappedState& State : StateHistory) {
-            if (State.ServerTick == LatestAuthorityState.ServerTick) {
-                HistoricState = &State;
-
-                break;
-            }
+        const WrappedState* HistoricStatePtr = StateHistory.FindByServerTick(LatestAuthorityState.ServerTick);
+        if (HistoricStatePtr == nullptr) {
+            return INDEX_NONE;
         }
 
-        if (HistoricState == nullptr) {
+        // The history may hand out a decoded copy, so the state is written back with Insert() below.
+        WrappedState HistoricState = *HistoricStatePtr;
+
+        const bool bPhysStateDiverged = HistoricState.PhysState.ShouldReconcile(LatestAuthorityState.PhysState);
+        if (!bPhysStateDiverged && !WrappedState::ShouldReconcileState(HistoricState.State, LatestAuthorityState.State)) {
             return INDEX_NONE;
         }
 
-        if (!HistoricState->PhysState.ShouldReconcile(LatestAuthorityState.PhysState) && !HistoricState->State.ShouldReconcile(LatestAuthorityState.State)) {
+        // If physics still matches the authority and the corrected state doesn't affect physics, only the state needs to be corrected. Rather than asking
+        // Chaos to resimulate the whole scene, the ticks after the correction are replayed with just the sim delegates.
+        if (!bPhysStateDiverged && ClientPredictionStateOnlyRollback && !WrappedState::ShouldResimulatePhysics(HistoricState.State, LatestAuthorityState.State)) {
+            HistoricState.State = LatestAuthorityState.State;
+            StateHistory.Insert(HistoricState.LocalTick, HistoricState);
+            PublishState(HistoricState.LocalTick, HistoricState);
+
+            const int32 ReplayTick = HistoricState.LocalTick + 1;
+            PendingStateReplayTick = PendingStateReplayTick == INDEX_NONE ? ReplayTick : FMath::Min(PendingStateReplayTick, ReplayTick);
+
+            UE_LOG(LogClientPrediction, Log, TEXT("Queueing state replay on %d (Server tick %d)"), ReplayTick, LatestAuthorityState.ServerTick);
             return INDEX_NONE;
         }
 
+        HistoricState.PhysState = LatestAuthorityState.PhysState;
+        HistoricState.State = LatestAuthorityState.State;
+        return QueueRewind(PhysSolver, PhysObject, HistoricState);
+    }
+
+    template <typename Traits>
+    int32 USimState<Traits>::QueueRewind(Chaos::FPhysicsSolver* PhysSolver, Chaos::FPhysicsObjectHandle PhysObject, const WrappedState& CorrectedState) {
+        Chaos::FRewindData* RewindData = PhysSolver->GetRewindData();
+        if (RewindData == nullptr) { return INDEX_NONE; }
+
         // Resimulating frames that were already once resimulated can be disallowed, so we ignore any corrections that would result in no resim.
         // We add one to the local tick since states are generated at the end of a tick and corrections are applied at the beginning. So if we didn't
         // add an offset we would end up simulating one extra tick.
-        const int32 RewindTick = HistoricState->LocalTick + 1;
+        const int32 RewindTick = CorrectedState.LocalTick + 1;
         const int32 BlockedResimTick = RewindData->GetBlockedResimFrame();
         if (BlockedResimTick != INDEX_NONE && RewindTick <= BlockedResimTick) {
             return INDEX_NONE;
         }
 
-        PendingCorrection = LatestAuthorityState;
+        PendingCorrection = CorrectedState;
         PendingCorrection->LocalTick = RewindTick;
 
-        HistoricState->PhysState = LatestAuthorityState.PhysState;
-        HistoricState->State = LatestAuthorityState.State;
+        StateHistory.Insert(CorrectedState.LocalTick, CorrectedState);
+        PublishState(CorrectedState.LocalTick, CorrectedState);
 
         Chaos::FReadPhysicsObjectInterface_Internal Interface = Chaos::FPhysicsObjectInternalInterface::GetRead();
         if (Chaos::FPBDRigidParticleHandle* ParticleHandle = Interface.GetRigidParticle(PhysObject)) {
@@ -525,10 +760,67 @@ namespace ClientPrediction {
         const int32 SolverResimTick = (RewindData->GetResimFrame() == INDEX_NONE) ? RewindTick : FMath::Min(RewindTick, RewindData->GetResimFrame());
         RewindData->SetResimFrame(SolverResimTick);
 
-        UE_LOG(LogClientPrediction, Warning, TEXT("Queueing correction on %d (Server tick %d)"), RewindTick, LatestAuthorityState.ServerTick);
+        UE_LOG(LogClientPrediction, Warning, TEXT("Queueing correction on %d (Server tick %d)"), RewindTick, CorrectedState.ServerTick);
         return RewindTick;
     }
 
+    template <typename Traits>
+    int32 USimState<Traits>::ReplayState(const FNetTickInfo& CurrentTickInfo, Chaos::FPhysicsSolver* PhysSolver, Chaos::FPhysicsObjectHandle PhysObject,
+                                         TFunctionRef<const InputType*(int32 ServerTick)> FindInput) {
+        const int32 FirstTick = PendingStateReplayTick;
+        PendingStateReplayTick = INDEX_NONE;
+
+        if (FirstTick == INDEX_NONE || SimDelegates == nullptr) { return INDEX_NONE; }
+
+        // The body is at the current tick rather than the replayed one, so the delegates don't get to touch it.
+        FNetTickInfo TickInfo = CurrentTickInfo;
+        TickInfo.bIsResim = true;
+        TickInfo.bIsStateReplay = true;
+        TickInfo.UpdatedComponent = nullptr;
+
+        for (int32 Tick = FirstTick; Tick <= StateHistory.GetNewestTick(); ++Tick) {
+            const WrappedState* ExistingState = StateHistory.Find(Tick);
+            const WrappedState* ReplayPrevState = StateHistory.FindLatestAtOrBefore(Tick - 1);
+            if (ExistingState == nullptr || ReplayPrevState == nullptr) { continue; }
+
+            // The final state is never predicted, so there is nothing to replay past it.
+            if (ExistingState->bIsFinalState) { break; }
+
+            // If the input is gone, the rest of the states are left as they are. Any remaining divergence will be corrected by the next authority state.
+            const InputType* Input = FindInput(ExistingState->ServerTick);
+            if (Input == nullptr) { break; }
+
+            // The physics state, ticks and times of the state are kept since physics is not being resimulated.
+            const StateType PredictedState = ExistingState->State;
+            WrappedState& ReplayedState = StateHistory.Emplace(Tick);
+            if (&ReplayedState != ExistingState) {
+                ReplayedState = *ExistingState;
+            }
+
+            TickInfo.LocalTick = ReplayedState.LocalTick;
+            TickInfo.ServerTick = ReplayedState.ServerTick;
+            TickInfo.StartTime = ReplayedState.StartTime;
+            TickInfo.EndTime = ReplayedState.EndTime;
+
+            ReplayedState.State = ReplayPrevState->State;
+
+            FTickOutput Output(ReplayedState.State, TickInfo, SimEvents);
+            SimDelegates->SimTickPrePhysicsDelegate.Broadcast(TickInfo, *Input, ReplayPrevState->State, Output);
+            SimDelegates->SimTickPostPhysicsDelegate.Broadcast(TickInfo, *Input, ReplayPrevState->State, Output);
+
+            StateHistory.Commit(Tick);
+            PublishState(Tick, ReplayedState);
+
+            // Physics after this tick ran with the predicted state. If the replayed one would have made it behave differently, it has to be resimulated.
+            if (WrappedState::ShouldResimulatePhysics(PredictedState, ReplayedState.State)) {
+                const WrappedState CorrectedState = ReplayedState;
+                return QueueRewind(PhysSolver, PhysObject, CorrectedState);
+            }
+        }
+
+        return INDEX_NONE;
+    }
+
     template <typename Traits>
     void USimState<Traits>::ApplyCorrectionIfNeeded(const FNetTickInfo& TickInfo) {
         if (!PendingCorrection.IsSet() || PendingCorrection->LocalTick != TickInfo.LocalTick) { return; }
@@ -549,19 +841,29 @@ namespace ClientPrediction {
 
     template <typename Traits>
     void USimState<Traits>::EmitStates() {
-        FScopeLock FinalStateLock(&FinalStateMutex);
-        FScopeLock StateLock(&StateMutex);
+        ConsumePublishedStates();
 
-        if (StateHistory.IsEmpty() || StateHistory.Last().ServerTick <= LatestEmittedTick) {
+        // Authorities key their history by local tick, which is the same as the server tick for them.
+        const WrappedState* NewestState = GameThreadHistory.Find(GameThreadHistory.GetNewestTick());
+        if (NewestState == nullptr || NewestState->ServerTick <= LatestEmittedTick) {
             return;
         }
 
-        if (FinalState.ServerTick != INDEX_NONE) {
-            FBundledPacketsFull FinalStatePacket{};
-            TArray<WrappedState> FinalStateArr = {FinalState};
+        // Looking up other states can invalidate NewestState, so anything needed from it later is captured here.
+        const int32 NewestServerTick = NewestState->ServerTick;
+
+        // The history is trimmed no further than the first unemitted state, so anything missing was overwritten because the game thread fell too far behind.
+        ensureMsgf(LatestEmittedTick == INDEX_NONE || GameThreadHistory.GetOldestTick() <= LatestEmittedTick + 1,
+                   TEXT("States %d to %d were overwritten before they were emitted. cp.HistoryWindowTicks should cover the longest game thread frame."),
+                   LatestEmittedTick + 1, GameThreadHistory.GetOldestTick() - 1);
+
+        const int32 FirstUnemittedTick = FMath::Max(LatestEmittedTick + 1, GameThreadHistory.GetOldestTick());
 
-            FinalStatePacket.Bundle().Store(FinalStateArr, &NetSerialize);
-            EmitFinalBundle.ExecuteIfBound(FinalStatePacket);
+        // The final state is always the newest state in the history since everything after it is removed.
+        if (NewestState->bIsFinalState) {
+            FinalStatePackets.Bundle().SetCompleteness(CompletenessFromCVar(ClientPredictionFinalStateCompleteness));
+            FinalStatePackets.Bundle().StoreEach<WrappedState>(1, &SendContext, [&](auto&& WritePacket) { WritePacket(*NewestState); });
+            EmitFinalBundle.ExecuteIfBound(FinalStatePackets);
 
             LatestEmittedTick = TNumericLimits<int32>::Max();
             return;
@@ -569,44 +871,67 @@ namespace ClientPrediction {
 
         // Auto proxies predict so they don't need every single state to be sent. We go backwards and find the one that matches the send interval that hasn't already been
         // emitted.
-        for (int32 StateIdx = StateHistory.Num() - 1; StateIdx >= 0; --StateIdx) {
-            if (StateHistory[StateIdx].ServerTick <= LatestEmittedTick) { break; }
-            if (StateHistory[StateIdx].ServerTick % ClientPredictionAutoProxySendInterval != 0) { continue; }
+        for (int32 Tick = GameThreadHistory.GetNewestTick(); Tick >= FirstUnemittedTick; --Tick) {
+            const WrappedState* State = GameThreadHistory.Find(Tick);
+            if (State == nullptr || State->ServerTick % ClientPredictionAutoProxySendInterval != 0) { continue; }
 
-            FBundledPacketsFull AutoProxyPackets{};
-            TArray<WrappedState> AutoProxyStates{StateHistory[StateIdx]};
-
-            AutoProxyPackets.Bundle().Store(AutoProxyStates, &NetSerialize);
+            AutoProxyPackets.Bundle().SetCompleteness(CompletenessFromCVar(ClientPredictionAutoProxyCompleteness));
+            AutoProxyPackets.Bundle().StoreEach<WrappedState>(1, &SendContext, [&](auto&& WritePacket) { WritePacket(*State); });
             EmitAutoProxyBundle.ExecuteIfBound(AutoProxyPackets);
 
             break;
         }
 
-        TArray<WrappedState> SimProxyStates;
-        for (const WrappedState& State : StateHistory) {
-            if (State.ServerTick > LatestEmittedTick && State.ServerTick % ClientPredictionSimProxySendInterval == 0) {
-                SimProxyStates.Add(State);
-            }
+        // States are written straight out of the history. A history that decodes states only guarantees the last one it handed out, which is all that
+        // is needed here since each state is written before the next one is looked up.
+        const int32 NewestTick = GameThreadHistory.GetNewestTick();
+        auto ShouldSendToSimProxies = [&](int32 Tick) {
+            const WrappedState* State = GameThreadHistory.Find(Tick);
+            return State != nullptr && State->ServerTick % ClientPredictionSimProxySendInterval == 0 ? State : nullptr;
+        };
+
+        bool bHasSimProxyStates = false;
+        for (int32 Tick = FirstUnemittedTick; Tick <= NewestTick && !bHasSimProxyStates; ++Tick) {
+            bHasSimProxyStates = ShouldSendToSimProxies(Tick) != nullptr;
         }
 
-        LatestEmittedTick = StateHistory.Last().ServerTick;
-        if (SimProxyStates.IsEmpty()) {
+        LatestEmittedTick = NewestServerTick;
+        if (!bHasSimProxyStates) {
             return;
         }
 
-        FBundledPacketsLow SimProxyPackets{};
-        SimProxyPackets.Bundle().Store(SimProxyStates, &NetSerialize);
+        SimProxyPackets.Bundle().SetCompleteness(CompletenessFromCVar(ClientPredictionSimProxyCompleteness));
+        SimProxyPackets.Bundle().StoreNewest<WrappedState>(NewestTick - FirstUnemittedTick + 1, &SendContext, [&](auto&& WritePacket) {
+            for (int32 Tick = FirstUnemittedTick; Tick <= NewestTick; ++Tick) {
+                if (const WrappedState* State = ShouldSendToSimProxies(Tick)) {
+                    WritePacket(*State);
+                }
+            }
+        });
+
         EmitSimProxyBundle.ExecuteIfBound(SimProxyPackets);
     }
 
     template <typename Traits>
     void USimState<Traits>::InterpolateGameThread(UPrimitiveComponent* UpdatedComponent, Chaos::FReal ResultsTime, Chaos::FReal SimProxyOffset, Chaos::FReal Dt,
                                                   ENetRole SimRole) {
-        if (UpdatedComponent == nullptr || SimDelegates == nullptr || !bGeneratedInitialState || bEndedSimOnGameThread) { return; }
+        if (UpdatedComponent == nullptr || SimDelegates == nullptr || bEndedSimOnGameThread) { return; }
+
+        ConsumePublishedStates();
+        if (!GameThreadInitialState.IsSet()) { return; }
 
         Chaos::FReal AdjustedResultsTime = SimRole != ROLE_SimulatedProxy ? ResultsTime : ResultsTime + SimProxyOffset;
         GetInterpolatedStateAtTime(AdjustedResultsTime, LastInterpolatedState);
 
+        // Interpolation only moves forward, so anything before the state it started from (and the state before that, for extrapolation) won't be read again.
+        // The authority also has to hold on to states that haven't been emitted yet.
+        int32 TrimTick = GameThreadHistory.FindLatestTickAtOrBefore(LatestInterpolatedTick - 1);
+        if (SimRole == ROLE_Authority && LatestEmittedTick != TNumericLimits<int32>::Max()) {
+            TrimTick = FMath::Min(TrimTick, LatestEmittedTick + 1);
+        }
+
+        GameThreadHistory.TrimBefore(TrimTick);
+
         FBodyInstance* BodyInstance = UpdatedComponent->GetBodyInstance();
         if (BodyInstance == nullptr) { return; }
 
@@ -645,24 +970,78 @@ namespace ClientPrediction {
     }
 
     template <typename Traits>
-    void USimState<Traits>::GetInterpolatedStateAtTime(Chaos::FReal ResultsTime, WrappedState& OutState) {
-        FScopeLock StateLock(&StateMutex);
+    void USimState<Traits>::ConsumePublishedStates() {
+        while (TOptional<FPublishedState> Published = PublishedStates.Dequeue()) {
+            INC_DWORD_STAT(STAT_ClientPredictionStatesConsumed);
+
+            if (Published->Tick == INDEX_NONE) {
+                GameThreadInitialState = MoveTemp(Published->State);
+                continue;
+            }
 
-        if (StateHistory.IsEmpty()) {
-            OutState = LastInterpolatedState;
+            GameThreadHistory.Insert(Published->Tick, Published->State);
+            if (Published->State.bIsFinalState) {
+                GameThreadHistory.TruncateAfter(Published->Tick);
+            }
+        }
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::SerializeForHistory(WrappedState& State, FArchive& Ar) {
+        // The history needs to reproduce the state exactly, so the full completeness is used along with the fields that are usually local only.
+        Ar << State.LocalTick;
+        Ar << State.StartTime;
+        Ar << State.EndTime;
+
+        FStateBundleContext HistoryContext{&NetSerialize};
+        State.NetSerialize(Ar, EDataCompleteness::kFull, &HistoryContext);
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::SerializeCompactForHistory(FCompactHistoryOrigin& Origin, int32 Tick, WrappedState& State, FArchive& Ar) {
+        if (Ar.IsSaving() && !Origin.bIsSet) {
+            Origin.X = State.PhysState.X;
+            Origin.Dt = State.EndTime - State.StartTime;
+            Origin.TimeOrigin = State.StartTime - static_cast<Chaos::FReal>(Tick) * Origin.Dt;
+            Origin.bIsSet = true;
+        }
+
+        uint8 bIsFinalState = State.bIsFinalState;
+        Ar << State.LocalTick;
+        Ar << State.ServerTick;
+        Ar << bIsFinalState;
+
+        State.PhysState.SerializeCompact(Ar, Origin.X);
+        WrappedState::SerializeState(State.State, Ar, EDataCompleteness::kFull, &NetSerialize);
+
+        // Every state in the history is one tick apart, so the times don't need to be stored.
+        if (Ar.IsLoading()) {
+            State.bIsFinalState = bIsFinalState != 0;
+            State.StartTime = Origin.TimeOrigin + static_cast<Chaos::FReal>(Tick) * Origin.Dt;
+            State.EndTime = State.StartTime + Origin.Dt;
+        }
+    }
+
+    template <typename Traits>
+    void USimState<Traits>::GetInterpolatedStateAtTime(Chaos::FReal ResultsTime, WrappedState& OutState) {
+        if (GameThreadHistory.IsEmpty()) {
+            OutState = GameThreadInitialState.GetValue();
             return;
         }
 
-        for (int StateIndex = 0; StateIndex < StateHistory.Num(); StateIndex++) {
-            if (StateHistory[StateIndex].EndTime < ResultsTime) { continue; }
+        int32 StartTick = INDEX_NONE;
+        int32 EndTick = INDEX_NONE;
+        GameThreadHistory.FindAroundTime(ResultsTime, StartTick, EndTick);
+        LatestInterpolatedTick = StartTick;
 
-            if (StateIndex == 0) {
-                OutState = StateHistory[0];
+        if (EndTick != INDEX_NONE) {
+            const WrappedState& End = *GameThreadHistory.Find(EndTick);
+            if (StartTick == INDEX_NONE) {
+                OutState = End;
                 return;
             }
 
-            const WrappedState& Start = StateHistory[StateIndex - 1];
-            const WrappedState& End = StateHistory[StateIndex];
+            const WrappedState& Start = *GameThreadHistory.Find(StartTick);
             OutState = Start;
 
             // This mostly mirrors the Chaos interpolation algorithm except we use the end time of the start state, rather than the end time of the end state.
@@ -674,16 +1053,22 @@ namespace ClientPrediction {
             return;
         }
 
-        OutState = StateHistory.Last();
+        if (StartTick == INDEX_NONE) {
+            OutState = GameThreadInitialState.GetValue();
+            return;
+        }
+
+        OutState = *GameThreadHistory.Find(StartTick);
 
-        if (StateHistory.Num() == 1 || OutState.bIsFinalState) {
+        const WrappedState* PrevExtrapolationStatePtr = GameThreadHistory.FindLatestAtOrBefore(StartTick - 1);
+        if (PrevExtrapolationStatePtr == nullptr || OutState.bIsFinalState) {
             return;
         }
 
         const Chaos::FReal ExtrapolationTime = ResultsTime - OutState.EndTime;
         if (ExtrapolationTime == 0.0) { return; }
 
-        const WrappedState& PrevExtrapolationState = StateHistory[StateHistory.Num() - 2];
+        const WrappedState& PrevExtrapolationState = *PrevExtrapolationStatePtr;
         const Chaos::FReal StateDt = OutState.EndTime - PrevExtrapolationState.EndTime;
         if (StateDt <= 0.0) { return; }
 
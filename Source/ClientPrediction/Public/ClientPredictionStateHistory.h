@@ -0,0 +1,476 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Chaos/Real.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+#include "ClientPredictionDeltaEncoding.h"
+#include "ClientPredictionStats.h"
+
+namespace ClientPrediction {
+    /**
+     * Fixed capacity ring buffer of states keyed by tick. The state for a tick always lives in slot Tick % Capacity, so inserting, detecting duplicates,
+     * looking up and trimming are all O(1) and never need to sort or shift other entries. States that fall more than Capacity ticks behind the newest
+     * tick are trimmed implicitly by being overwritten. States are also indexed by their server tick so that authority states can be matched without a search.
+     *
+     * The ticks and end times of every slot are kept in a separate dense array so that searching by time never touches the (potentially large) states.
+     *
+     * Optionally states can be stored serialized with SetSerializedStorage(), which allows a more compact representation than StateType itself. The
+     * serialized states can additionally be delta compressed: ticks are then grouped into blocks of KeyframeInterval ticks, the first state written to a block
+     * is kept as the keyframe for that block and every state in the block is stored as a delta against it. Serialized states are reconstructed on demand by
+     * Find() into a small cache, so the pointers it returns are only valid until the next Insert() or until kDecodeCacheSize other states have been
+     * reconstructed.
+     */
+    template <typename StateType>
+    class TStateHistory {
+    public:
+        /** Serializes the state stored for a tick. The tick is passed along so that anything that can be derived from it doesn't need to be stored. */
+        using FSerializer = TFunction<void(int32 Tick, StateType&, FArchive&)>;
+
+        TStateHistory() = default;
+        ~TStateHistory();
+
+        TStateHistory(const TStateHistory&) = delete;
+        TStateHistory& operator=(const TStateHistory&) = delete;
+
+        /** Clears the history. The capacity must be at least 2 so that a state being emplaced never shares a slot with the state before it. */
+        void SetCapacity(int32 NewCapacity);
+        int32 Capacity() const { return Keys.Num(); }
+
+        /**
+         * Stores states serialized with NewSerializer rather than as StateType. If NewKeyframeInterval is greater than 1, states are also stored as deltas
+         * against a keyframe written every NewKeyframeInterval ticks. Passing an unset serializer goes back to storing StateType. This clears the history, so
+         * it should be called before SetCapacity().
+         */
+        void SetSerializedStorage(const FSerializer& NewSerializer, int32 NewKeyframeInterval);
+
+        /** The memory used by the history itself. This is also reported to STAT_ClientPredictionStateHistoryMemory. */
+        SIZE_T GetAllocatedSize() const { return static_cast<SIZE_T>(AllocatedBytes); }
+
+        bool IsEmpty() const { return NewestTick == INDEX_NONE; }
+        int32 GetNewestTick() const { return NewestTick; }
+        int32 GetOldestTick() const { return IsEmpty() ? INDEX_NONE : FMath::Max3(NewestTick - Capacity() + 1, TrimmedBeforeTick, 0); }
+
+        bool Contains(int32 Tick) const { return IsValidTick(Tick); }
+
+        const StateType* Find(int32 Tick) const;
+        const StateType* FindByServerTick(int32 ServerTick) const;
+
+        /** Returns the newest state at or before Tick, or nullptr if there isn't one in the history. */
+        const StateType* FindLatestAtOrBefore(int32 Tick) const;
+        int32 FindLatestTickAtOrBefore(int32 Tick) const;
+
+        /** Returns false if Tick is too old to fit in the history. */
+        bool Insert(int32 Tick, const StateType& State);
+
+        /**
+         * Returns storage that the state for Tick can be written to in place. The state is only added to the history once Commit() is called with the same
+         * tick and nothing else should be inserted in between. Uncompressed histories hand out the slot itself so no copy is made, and pointers to the other
+         * states in the history remain valid while the state is being written.
+         */
+        StateType& Emplace(int32 Tick);
+        bool Commit(int32 Tick);
+
+        /** Drops a state that was emplaced but won't be committed. Whatever its slot held before Emplace() is not restored. */
+        void Discard(int32 Tick);
+
+        /** Removes every state newer than Tick. */
+        void TruncateAfter(int32 Tick);
+
+        /**
+         * Hides every state older than Tick once the owner knows they will never be read again. This keeps searches bounded to the states that are still in
+         * use. Inserting an older state afterwards makes it visible again.
+         */
+        void TrimBefore(int32 Tick);
+
+        /**
+         * Finds the newest state that ends before Time and the first state that ends at or after it. Either tick is INDEX_NONE if there is no such state.
+         * The game thread only moves forward in time between rewinds, so each search resumes from where the previous one ended. A binary search is only used
+         * after time jumps backwards or the previous position has been trimmed.
+         */
+        void FindAroundTime(Chaos::FReal Time, int32& OutBeforeTick, int32& OutAfterTick);
+
+    private:
+        struct FSlotKey {
+            int32 Tick = TNumericLimits<int32>::Min();
+            int32 ServerTick = INDEX_NONE;
+            Chaos::FReal EndTime = 0.0;
+        };
+
+        struct FKeyframe {
+            int32 Block = INDEX_NONE;
+            TArray<uint8> Bytes;
+        };
+
+        struct FDecodedState {
+            int32 Tick = TNumericLimits<int32>::Min();
+            StateType State{};
+        };
+
+        int32 SlotIndex(int32 Tick) const;
+        bool IsValidTick(int32 Tick) const;
+        int32 FindLatestBeforeTime(Chaos::FReal Time) const;
+
+        bool IsSerialized() const { return static_cast<bool>(Serializer); }
+        bool IsDeltaEncoded() const { return IsSerialized() && KeyframeInterval > 1; }
+        bool CanInsert(int32 Tick) const;
+        void AddKey(int32 Tick, const StateType& State);
+        const StateType* GetState(int32 Tick) const;
+        const StateType* DecodeState(int32 Tick) const;
+        void EncodeState(int32 Tick, const StateType& State);
+        void TrackAllocatedSize(int64 Delta);
+
+        static constexpr int32 kInvalidTick = TNumericLimits<int32>::Min();
+        static constexpr int32 kDecodeCacheSize = 4;
+
+        TArray<StateType> Slots;
+        TArray<FSlotKey> Keys;
+
+        /** Used by Emplace() when the state can't be written directly to its slot. */
+        StateType PendingState{};
+        int32 PendingTick = kInvalidTick;
+
+        // Only used when the states are stored serialized
+        FSerializer Serializer;
+        int32 KeyframeInterval = 0;
+
+        TArray<FKeyframe> Keyframes;
+        TArray<TArray<uint8>> SerializedSlots;
+        TArray<uint8> ScratchBytes;
+
+        mutable TArray<uint8> DecodeScratchBytes;
+        mutable FDecodedState DecodeCache[kDecodeCacheSize];
+        mutable int32 NextDecodeCacheEntry = 0;
+
+        int64 AllocatedBytes = 0;
+
+        /** Maps a server tick to the tick the state was inserted with. */
+        TArray<int32> ServerTickIndex;
+
+        int32 NewestTick = INDEX_NONE;
+        int32 TrimmedBeforeTick = INDEX_NONE;
+        int32 TimeCursorTick = INDEX_NONE;
+    };
+
+    template <typename StateType>
+    TStateHistory<StateType>::~TStateHistory() {
+        TrackAllocatedSize(-AllocatedBytes);
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::SetCapacity(int32 NewCapacity) {
+        check(NewCapacity > 1);
+
+        Keys.Reset();
+        Keys.SetNum(NewCapacity);
+        ServerTickIndex.Init(kInvalidTick, NewCapacity);
+
+        Slots.Reset();
+        Keyframes.Reset();
+        SerializedSlots.Reset();
+
+        if (IsSerialized()) {
+            SerializedSlots.SetNum(NewCapacity);
+        }
+        else {
+            Slots.SetNum(NewCapacity);
+        }
+
+        if (IsDeltaEncoded()) {
+            // One extra keyframe guarantees that a keyframe is never overwritten while states in its block are still in the history.
+            Keyframes.SetNum(FMath::DivideAndRoundUp(NewCapacity, KeyframeInterval) + 1);
+        }
+
+        for (FDecodedState& DecodedState : DecodeCache) {
+            DecodedState.Tick = kInvalidTick;
+        }
+
+        NewestTick = INDEX_NONE;
+        TrimmedBeforeTick = INDEX_NONE;
+        TimeCursorTick = INDEX_NONE;
+        PendingTick = kInvalidTick;
+
+        TrackAllocatedSize(Slots.GetAllocatedSize() + Keys.GetAllocatedSize() + ServerTickIndex.GetAllocatedSize() + Keyframes.GetAllocatedSize() +
+                           SerializedSlots.GetAllocatedSize() - AllocatedBytes);
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::SetSerializedStorage(const FSerializer& NewSerializer, int32 NewKeyframeInterval) {
+        Serializer = NewSerializer;
+        KeyframeInterval = NewKeyframeInterval;
+
+        if (Capacity() > 0) {
+            SetCapacity(Capacity());
+        }
+    }
+
+    template <typename StateType>
+    int32 TStateHistory<StateType>::SlotIndex(int32 Tick) const {
+        const int32 NumSlots = Keys.Num();
+        return (Tick % NumSlots + NumSlots) % NumSlots;
+    }
+
+    template <typename StateType>
+    bool TStateHistory<StateType>::IsValidTick(int32 Tick) const {
+        if (IsEmpty() || Tick < GetOldestTick() || Tick > NewestTick) { return false; }
+        return Keys[SlotIndex(Tick)].Tick == Tick;
+    }
+
+    template <typename StateType>
+    const StateType* TStateHistory<StateType>::Find(int32 Tick) const {
+        return IsValidTick(Tick) ? GetState(Tick) : nullptr;
+    }
+
+    template <typename StateType>
+    const StateType* TStateHistory<StateType>::FindByServerTick(int32 ServerTick) const {
+        if (IsEmpty() || ServerTick < 0) { return nullptr; }
+
+        const int32 Tick = ServerTickIndex[SlotIndex(ServerTick)];
+        return IsValidTick(Tick) && Keys[SlotIndex(Tick)].ServerTick == ServerTick ? GetState(Tick) : nullptr;
+    }
+
+    template <typename StateType>
+    const StateType* TStateHistory<StateType>::FindLatestAtOrBefore(int32 Tick) const {
+        const int32 LatestTick = FindLatestTickAtOrBefore(Tick);
+        return LatestTick != INDEX_NONE ? GetState(LatestTick) : nullptr;
+    }
+
+    template <typename StateType>
+    int32 TStateHistory<StateType>::FindLatestTickAtOrBefore(int32 Tick) const {
+        if (IsEmpty()) { return INDEX_NONE; }
+
+        // Ticks are usually contiguous, so this almost always returns on the first iteration.
+        for (int32 CurrentTick = FMath::Min(Tick, NewestTick); CurrentTick >= GetOldestTick(); --CurrentTick) {
+            if (IsValidTick(CurrentTick)) {
+                return CurrentTick;
+            }
+        }
+
+        return INDEX_NONE;
+    }
+
+    template <typename StateType>
+    bool TStateHistory<StateType>::Insert(int32 Tick, const StateType& State) {
+        if (!CanInsert(Tick)) { return false; }
+
+        if (IsSerialized()) {
+            EncodeState(Tick, State);
+        }
+        else {
+            Slots[SlotIndex(Tick)] = State;
+        }
+
+        AddKey(Tick, State);
+        return true;
+    }
+
+    template <typename StateType>
+    StateType& TStateHistory<StateType>::Emplace(int32 Tick) {
+        PendingTick = Tick;
+        if (IsSerialized() || !CanInsert(Tick)) { return PendingState; }
+
+        // Whatever the slot held is being overwritten, so it can't be looked up until the new state is committed.
+        const int32 Index = SlotIndex(Tick);
+        Keys[Index].Tick = kInvalidTick;
+
+        return Slots[Index];
+    }
+
+    template <typename StateType>
+    bool TStateHistory<StateType>::Commit(int32 Tick) {
+        check(PendingTick == Tick);
+        PendingTick = kInvalidTick;
+
+        if (!CanInsert(Tick)) { return false; }
+
+        if (IsSerialized()) {
+            EncodeState(Tick, PendingState);
+            AddKey(Tick, PendingState);
+        }
+        else {
+            AddKey(Tick, Slots[SlotIndex(Tick)]);
+        }
+
+        return true;
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::Discard(int32 Tick) {
+        check(PendingTick == Tick);
+        PendingTick = kInvalidTick;
+    }
+
+    template <typename StateType>
+    bool TStateHistory<StateType>::CanInsert(int32 Tick) const {
+        if (Keys.IsEmpty() || Tick < 0) { return false; }
+        return IsEmpty() || Tick > NewestTick - Capacity();
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::AddKey(int32 Tick, const StateType& State) {
+        NewestTick = FMath::Max(NewestTick, Tick);
+        TrimmedBeforeTick = FMath::Min(TrimmedBeforeTick, Tick);
+        Keys[SlotIndex(Tick)] = {Tick, State.ServerTick, State.EndTime};
+
+        if (State.ServerTick >= 0) {
+            ServerTickIndex[SlotIndex(State.ServerTick)] = Tick;
+        }
+    }
+
+    template <typename StateType>
+    const StateType* TStateHistory<StateType>::GetState(int32 Tick) const {
+        return IsSerialized() ? DecodeState(Tick) : &Slots[SlotIndex(Tick)];
+    }
+
+    template <typename StateType>
+    const StateType* TStateHistory<StateType>::DecodeState(int32 Tick) const {
+        for (const FDecodedState& DecodedState : DecodeCache) {
+            if (DecodedState.Tick == Tick) { return &DecodedState.State; }
+        }
+
+        const TArray<uint8>* Bytes = &SerializedSlots[SlotIndex(Tick)];
+        if (IsDeltaEncoded()) {
+            const int32 Block = Tick / KeyframeInterval;
+            const FKeyframe& Keyframe = Keyframes[Block % Keyframes.Num()];
+            check(Keyframe.Block == Block);
+
+            if (!FDeltaEncoding::Decode(Keyframe.Bytes, *Bytes, MAX_int32, DecodeScratchBytes)) {
+                return nullptr;
+            }
+
+            Bytes = &DecodeScratchBytes;
+        }
+
+        FDecodedState& DecodedState = DecodeCache[NextDecodeCacheEntry];
+        NextDecodeCacheEntry = (NextDecodeCacheEntry + 1) % kDecodeCacheSize;
+
+        DecodedState.Tick = Tick;
+        DecodedState.State = StateType{};
+
+        FMemoryReader Reader(*Bytes);
+        Serializer(Tick, DecodedState.State, Reader);
+
+        return &DecodedState.State;
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::EncodeState(int32 Tick, const StateType& State) {
+        for (FDecodedState& DecodedState : DecodeCache) {
+            if (DecodedState.Tick == Tick) { DecodedState.Tick = kInvalidTick; }
+        }
+
+        ScratchBytes.Reset();
+        FMemoryWriter Writer(ScratchBytes);
+        Serializer(Tick, const_cast<StateType&>(State), Writer);
+
+        TArray<uint8>& SlotBytes = SerializedSlots[SlotIndex(Tick)];
+        const int64 PrevSlotSize = SlotBytes.GetAllocatedSize();
+
+        if (!IsDeltaEncoded()) {
+            SlotBytes.Reset();
+            SlotBytes.Append(ScratchBytes);
+
+            TrackAllocatedSize(static_cast<int64>(SlotBytes.GetAllocatedSize()) - PrevSlotSize);
+            return;
+        }
+
+        // The keyframe is never rewritten while its block is alive, so deltas stay valid even if the state that produced the keyframe is overwritten.
+        const int32 Block = Tick / KeyframeInterval;
+        FKeyframe& Keyframe = Keyframes[Block % Keyframes.Num()];
+        if (Keyframe.Block != Block) {
+            const int64 PrevKeyframeSize = Keyframe.Bytes.GetAllocatedSize();
+
+            Keyframe.Block = Block;
+            Keyframe.Bytes.Reset();
+            Keyframe.Bytes.Append(ScratchBytes);
+
+            TrackAllocatedSize(static_cast<int64>(Keyframe.Bytes.GetAllocatedSize()) - PrevKeyframeSize);
+        }
+
+        FDeltaEncoding::Encode(Keyframe.Bytes, ScratchBytes, SlotBytes);
+        TrackAllocatedSize(static_cast<int64>(SlotBytes.GetAllocatedSize()) - PrevSlotSize);
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::TrackAllocatedSize(int64 Delta) {
+        AllocatedBytes += Delta;
+
+        if (Delta > 0) { INC_MEMORY_STAT_BY(STAT_ClientPredictionStateHistoryMemory, Delta); }
+        if (Delta < 0) { DEC_MEMORY_STAT_BY(STAT_ClientPredictionStateHistoryMemory, -Delta); }
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::TruncateAfter(int32 Tick) {
+        if (IsEmpty() || Tick >= NewestTick) { return; }
+
+        // Trimmed states still occupy their slots, so they need to be invalidated as well.
+        const int32 FirstRemovedTick = FMath::Max3(Tick + 1, NewestTick - Capacity() + 1, 0);
+        for (int32 RemovedTick = FirstRemovedTick; RemovedTick <= NewestTick; ++RemovedTick) {
+            const int32 Index = SlotIndex(RemovedTick);
+            if (Keys[Index].Tick == RemovedTick) {
+                Keys[Index].Tick = kInvalidTick;
+            }
+        }
+
+        NewestTick = Tick >= 0 ? Tick : INDEX_NONE;
+        TrimmedBeforeTick = FMath::Min(TrimmedBeforeTick, NewestTick);
+        TimeCursorTick = FMath::Min(TimeCursorTick, NewestTick);
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::TrimBefore(int32 Tick) {
+        if (IsEmpty()) { return; }
+        TrimmedBeforeTick = FMath::Clamp(Tick, TrimmedBeforeTick, NewestTick);
+    }
+
+    template <typename StateType>
+    void TStateHistory<StateType>::FindAroundTime(Chaos::FReal Time, int32& OutBeforeTick, int32& OutAfterTick) {
+        OutBeforeTick = INDEX_NONE;
+        OutAfterTick = INDEX_NONE;
+        if (IsEmpty()) { return; }
+
+        // The cursor is only usable if it is still in the history and time has not moved back past it.
+        const bool bCursorValid = IsValidTick(TimeCursorTick) && Keys[SlotIndex(TimeCursorTick)].EndTime < Time;
+        OutBeforeTick = bCursorValid ? TimeCursorTick : FindLatestBeforeTime(Time);
+
+        const int32 FirstTick = OutBeforeTick != INDEX_NONE ? OutBeforeTick + 1 : GetOldestTick();
+        for (int32 Tick = FirstTick; Tick <= NewestTick; ++Tick) {
+            if (!IsValidTick(Tick)) { continue; }
+
+            if (Keys[SlotIndex(Tick)].EndTime >= Time) {
+                OutAfterTick = Tick;
+                break;
+            }
+
+            OutBeforeTick = Tick;
+        }
+
+        TimeCursorTick = OutBeforeTick;
+    }
+
+    template <typename StateType>
+    int32 TStateHistory<StateType>::FindLatestBeforeTime(Chaos::FReal Time) const {
+        int32 Result = INDEX_NONE;
+        int32 Low = GetOldestTick();
+        int32 High = NewestTick;
+
+        // End times increase with the tick, but there can be gaps in the ticks, so each probe moves forward to the next state that is actually present.
+        while (Low <= High) {
+            const int32 Mid = Low + (High - Low) / 2;
+
+            int32 Probe = Mid;
+            while (Probe <= High && !IsValidTick(Probe)) { ++Probe; }
+
+            if (Probe <= High && Keys[SlotIndex(Probe)].EndTime < Time) {
+                Result = Probe;
+                Low = Probe + 1;
+            }
+            else {
+                High = Mid - 1;
+            }
+        }
+
+        return Result;
+    }
+}
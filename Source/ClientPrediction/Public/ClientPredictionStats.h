@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+DECLARE_STATS_GROUP(TEXT("ClientPrediction"), STATGROUP_ClientPrediction, STATCAT_Advanced);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("States Published (PT)"), STAT_ClientPredictionStatesPublished, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("States Consumed (GT)"), STAT_ClientPredictionStatesConsumed, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Lock Waits"), STAT_ClientPredictionLockWaits, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Compression Cache Hits"), STAT_ClientPredictionCompressionCacheHits, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Compression Cache Misses"), STAT_ClientPredictionCompressionCacheMisses, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundle Bytes Raw"), STAT_ClientPredictionBundleBytesRaw, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundle Bytes In (LZ4)"), STAT_ClientPredictionBundleBytesInLZ4, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundle Bytes Out (LZ4)"), STAT_ClientPredictionBundleBytesOutLZ4, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Bundle Encode Time ms (LZ4)"), STAT_ClientPredictionBundleEncodeMsLZ4, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundle Bytes In (Zlib)"), STAT_ClientPredictionBundleBytesInZlib, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundle Bytes Out (Zlib)"), STAT_ClientPredictionBundleBytesOutZlib, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Bundle Encode Time ms (Zlib)"), STAT_ClientPredictionBundleEncodeMsZlib, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundle Bytes In (Oodle)"), STAT_ClientPredictionBundleBytesInOodle, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundle Bytes Out (Oodle)"), STAT_ClientPredictionBundleBytesOutOodle, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Bundle Encode Time ms (Oodle)"), STAT_ClientPredictionBundleEncodeMsOodle, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Baseline Keyframes Sent"), STAT_ClientPredictionBaselineKeyframes, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Baseline Deltas Sent"), STAT_ClientPredictionBaselineDeltas, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundles Split"), STAT_ClientPredictionBundlesSplit, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bundle Packets Dropped"), STAT_ClientPredictionBundlePacketsDropped, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Resim Ticks Skipped"), STAT_ClientPredictionResimTicksSkipped, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("State History Memory"), STAT_ClientPredictionStateHistoryMemory, STATGROUP_ClientPrediction, CLIENTPREDICTION_API);
+
+namespace ClientPrediction {
+    /** A scope lock that increments STAT_ClientPredictionLockWaits whenever it has to wait for another thread to release the lock. */
+    class FCountedScopeLock {
+    public:
+        explicit FCountedScopeLock(FCriticalSection* InMutex) : Mutex(InMutex) {
+            if (!Mutex->TryLock()) {
+                INC_DWORD_STAT(STAT_ClientPredictionLockWaits);
+                Mutex->Lock();
+            }
+        }
+
+        ~FCountedScopeLock() { Mutex->Unlock(); }
+
+        FCountedScopeLock(const FCountedScopeLock&) = delete;
+        FCountedScopeLock& operator=(const FCountedScopeLock&) = delete;
+
+    private:
+        FCriticalSection* Mutex;
+    };
+}
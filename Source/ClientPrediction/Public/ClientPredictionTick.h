@@ -11,6 +11,9 @@ namespace ClientPrediction {
 
         Chaos::FReal Dt = 0.0;
         bool bIsResim = false;
+
+        /** True when only the user state is being replayed after a correction. Physics is not stepped or rewound during a replay. */
+        bool bIsStateReplay = false;
     };
 
     struct FNetTickInfo : public FTickInfo {
@@ -25,11 +28,18 @@ namespace ClientPrediction {
     };
 
     struct FSimTickInfo {
-        FSimTickInfo(const FNetTickInfo& Info) : LocalTick(Info.LocalTick), Dt(Info.Dt), UpdatedComponent(Info.UpdatedComponent) {}
+        FSimTickInfo(const FNetTickInfo& Info) : LocalTick(Info.LocalTick), Dt(Info.Dt), bIsStateReplay(Info.bIsStateReplay),
+                                                 UpdatedComponent(Info.UpdatedComponent) {}
 
         int32 LocalTick = INDEX_NONE;
         Chaos::FReal Dt = 0.0;
 
+        /**
+         * True when the tick is being replayed because only the state diverged from the authority. The physics body is NOT at the state of this tick, so
+         * UpdatedComponent is null and the tick should only depend on the input and the previous state.
+         */
+        bool bIsStateReplay = false;
+
         class UPrimitiveComponent* UpdatedComponent = nullptr;
     };
 }
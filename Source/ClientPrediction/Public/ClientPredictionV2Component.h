@@ -21,16 +21,35 @@ public:
     virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
     virtual void UninitializeComponent() override;
 
+    /**
+     * NetSerialize is called from the game and physics threads. With cp.AsyncBundleDecode it is also called from worker threads, possibly for several
+     * sims at once, so it must then be thread-safe: it may only touch the state and archive it is given, and nothing shared without synchronization.
+     */
     template <typename Traits>
     TSharedPtr<ClientPrediction::FSimDelegates<Traits>> CreateSimulation(
         const TFunction<void(typename Traits::StateType&, FArchive& Ar, ClientPrediction::EDataCompleteness)>& NetSerialize);
 
+    /** Creates a simulation whose state is serialized with Traits::StateSchema. */
+    template <typename Traits> requires ClientPrediction::CHasStateSchema<Traits>
+    TSharedPtr<ClientPrediction::FSimDelegates<Traits>> CreateSimulation() { return CreateSimulation<Traits>(nullptr); }
+
+    void ConsumeSimProxyStatesAck(const UPackageMap* Connection, uint32 Sequence);
+    void ConsumeEvents(const FBundledPackets& Bundle);
+
 private:
     void DestroySimulation();
+    void QueueSimProxyStatesAck(uint32 Sequence);
+    void EmitEvents(const FBundledPackets& Bundle, ClientPrediction::EEventDelivery Delivery);
 
     UFUNCTION(Server, Unreliable)
     void ServerRecvInput(const FBundledPackets& Bundle);
 
+    UPROPERTY(ReplicatedUsing=OnRep_InputAck, Transient)
+    FInputAck InputAck;
+
+    UFUNCTION()
+    void OnRep_InputAck();
+
     UPROPERTY(ReplicatedUsing=OnRep_SimProxyStates, Transient)
     FBundledPacketsLow SimProxyStates;
 
@@ -81,12 +100,16 @@ TSharedPtr<ClientPrediction::FSimDelegates<Traits>> UClientPredictionV2Component
         ServerRecvInput(Bundle);
     });
 
+    InputImpl->EmitInputAckDelegate.BindLambda([&](const FInputAck& Ack) { InputAck = Ack; });
+
 
     StateImpl->EmitSimProxyBundle.BindLambda([&](const FBundledPacketsLow& Packets) { SimProxyStates.Bundle().Copy(Packets.Bundle()); });
     StateImpl->EmitAutoProxyBundle.BindLambda([&](const FBundledPacketsFull& Packets) { AutoProxyStates.Bundle().Copy(Packets.Bundle()); });
     StateImpl->EmitFinalBundle.BindLambda([&](const FBundledPacketsFull& Packets) { FinalState.Bundle().Copy(Packets.Bundle()); });
 
-    SimEvents->EmitEventBundle.BindUFunction(this, TEXT("ClientRecvEvents"));
+    SimEvents->EmitEventBundle.BindWeakLambda(this, [&](const FBundledPackets& Bundle, ClientPrediction::EEventDelivery Delivery) { EmitEvents(Bundle, Delivery); });
+
+    Impl->SimProxyStatesAckDelegate.BindWeakLambda(this, [&](uint32 Sequence) { QueueSimProxyStatesAck(Sequence); });
 
     Impl->RemoteSimProxyOffsetChangedDelegate.BindWeakLambda(this, [&](const FRemoteSimProxyOffset& Offset) {
         if (!ShouldSendToServer()) { return; }